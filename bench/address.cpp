@@ -0,0 +1,71 @@
+// Parsing of 1M IPv4 and IPv6 addresses, against inet_pton.
+// g++ -std=c++23 -O2 -I. bench/address.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <random>
+#include <string>
+#include <vector>
+
+template <typename F>
+double ns_per_value(const std::vector<std::string>& values, F parse)
+{
+    double best = 1e300;
+    for(int run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(auto& s : values)
+            parse(s);
+        std::chrono::duration<double, std::nano> t =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, t.count() / values.size());
+    }
+    return best;
+}
+
+int main()
+{
+    constexpr size_t n = 1'000'000;
+    std::mt19937 rng{42};
+    std::vector<std::string> v4, v6;
+    for(size_t i = 0; i < n; i++)
+    {
+        v4.push_back(std::format("{}.{}.{}.{}", rng() % 256, rng() % 256,
+                                 rng() % 256, rng() % 256));
+        if(i % 2)
+            v6.push_back(std::format("2001:db8:{:x}:{:x}::{:x}", rng() % 65536,
+                                     rng() % 65536, rng() % 65536));
+        else
+            v6.push_back(std::format("fe80::{:x}:{:x}:{:x}:{:x}",
+                                     rng() % 65536, rng() % 65536,
+                                     rng() % 65536, rng() % 65536));
+    }
+
+    size_t ok = 0;
+    unsigned char buf[16];
+    auto cozy_v4 = ns_per_value(v4, [&](const std::string& s) {
+        cozy::ipv4_address x;
+        ok += bool(cozy::parser_traits<cozy::ipv4_address>::parse(s, &x));
+    });
+    auto pton_v4 = ns_per_value(v4, [&](const std::string& s) {
+        ok += inet_pton(AF_INET, s.c_str(), buf) == 1;
+    });
+    auto cozy_v6 = ns_per_value(v6, [&](const std::string& s) {
+        cozy::ipv6_address x;
+        ok += bool(cozy::parser_traits<cozy::ipv6_address>::parse(s, &x));
+    });
+    auto pton_v6 = ns_per_value(v6, [&](const std::string& s) {
+        ok += inet_pton(AF_INET6, s.c_str(), buf) == 1;
+    });
+
+    std::printf("ipv4: cozy %5.1f ns, inet_pton %5.1f ns per address\n",
+                cozy_v4, pton_v4);
+    std::printf("ipv6: cozy %5.1f ns, inet_pton %5.1f ns per address\n",
+                cozy_v6, pton_v6);
+    // every run of every parser accepts every address
+    return ok != 4 * 5 * n;
+}
@@ -0,0 +1,57 @@
+// Latency of parser_t::complete by flag count.
+// g++ -std=c++23 -O2 -I. bench/complete.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <string>
+#include <string_view>
+#include <vector>
+
+int main()
+{
+    for(size_t n : {100, 1000, 10000, 100000})
+    {
+        std::vector<int> values(n);
+        cozy::parser_t parser;
+        parser.reserve_owned(n, n * 24);
+        for(size_t i = 0; i < n; i++)
+            parser.owned_flag(std::format("--group{}.option{}", i % 97, i), "",
+                              cozy::make_parse_arg(values[i]));
+
+        // the first call also builds the index
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::string_view> first{"--group1"};
+        (void)parser.complete(std::span{first});
+        auto freeze = std::chrono::steady_clock::now() - start;
+
+        // one query per keypress of a long flag
+        auto name = std::format("--group{}.option{}", 42 % 97, 42);
+        size_t candidates = 0;
+        start = std::chrono::steady_clock::now();
+        for(size_t len = 3; len <= name.size(); len++)
+        {
+            std::vector<std::string_view> args{
+                std::string_view{name}.substr(0, len)};
+            candidates += parser.complete(std::span{args}).size();
+        }
+        auto keys = name.size() - 2;
+        auto per_key = (std::chrono::steady_clock::now() - start) / keys;
+
+        // a prefix matching one flag, which costs as much as the name is long
+        std::vector<std::string_view> unique{name};
+        start = std::chrono::steady_clock::now();
+        for(int i = 0; i < 1000; i++)
+            candidates += parser.complete(std::span{unique}).size();
+        auto one = (std::chrono::steady_clock::now() - start) / 1000;
+
+        // Short prefixes match most flags, so the mean per key is dominated by
+        // formatting the candidates.
+        using us = std::chrono::duration<double, std::micro>;
+        std::printf("%6zu flags: first call %9.1f us, mean per key %8.1f us, "
+                    "unique prefix %5.2f us\n",
+                    n, us(freeze).count(), us(per_key).count(),
+                    us(one).count());
+    }
+}
@@ -0,0 +1,71 @@
+// Scaling of parse_many from 1 to 64 threads, on arg lists whose sizes vary
+// by three orders of magnitude.
+// g++ -std=c++23 -O2 -I. bench/parse_many.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct job_t
+{
+    int priority = 0;
+    std::string name;
+    std::vector<int> cpus;
+    std::vector<std::string> env;
+};
+
+int main()
+{
+    job_t prototype;
+    cozy::parser_t parser;
+    parser.flag("-p", "priority", prototype.priority);
+    parser.flag("--name", "name", prototype.name);
+    parser.flag("--cpus", "cpus", prototype.cpus);
+    parser.flag("--env", "environment", prototype.env);
+
+    // Most lists are short, a few have thousands of values.
+    std::mt19937 rng{42};
+    std::vector<std::vector<std::string>> lists(20000);
+    size_t args = 0;
+    for(auto& list : lists)
+    {
+        list = {"-p", std::to_string(rng() % 100), "--name", "job", "--cpus"};
+        auto n = size_t(std::exp2(rng() % 1000 / 100.0));
+        for(size_t i = 0; i < n; i++)
+            list.push_back(std::to_string(rng() % 256));
+        list.push_back("--env");
+        for(size_t i = 0; i < n; i++)
+            list.push_back("KEY=value");
+        args += list.size();
+    }
+
+    std::vector<job_t> outputs(lists.size());
+    std::printf("%zu lists, %zu args, %u hardware threads\n", lists.size(),
+                args, std::thread::hardware_concurrency());
+    double single = 0;
+    for(unsigned threads = 1; threads <= 64; threads *= 2)
+    {
+        double best = 1e300;
+        for(int run = 0; run < 3; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto results =
+                parser.parse_many(prototype, lists, std::span{outputs}, threads);
+            std::chrono::duration<double, std::milli> t =
+                std::chrono::steady_clock::now() - start;
+            for(auto& result : results)
+                if(!result)
+                    return 1;
+            best = std::min(best, t.count());
+        }
+        if(threads == 1)
+            single = best;
+        std::printf("%2u threads: %7.1f ms, %5.2fx\n", threads, best,
+                    single / best);
+    }
+}
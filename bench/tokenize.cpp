@@ -0,0 +1,66 @@
+// Throughput of semantic_tokenize on 1M arguments, about 2% of them flags.
+// g++ -std=c++23 -O2 -I. bench/tokenize.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+template <typename F>
+double best_ms(F f)
+{
+    double best = 1e300;
+    for(int run = 0; run < 7; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double, std::milli> t =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, t.count());
+    }
+    return best;
+}
+
+int main()
+{
+    constexpr size_t n = 1'000'000;
+    std::mt19937 rng{42};
+    std::vector<std::string> args;
+    for(size_t i = 0; i < n; i++)
+    {
+        switch(rng() % 100)
+        {
+        case 0: args.push_back("--output=file.txt"); break;
+        case 1: args.push_back("-abc"); break;
+        default: args.push_back(std::to_string(rng()));
+        }
+    }
+    std::span<std::string> span{args};
+
+    using cozy::detail::token_kind_t;
+    std::vector<std::string_view> tokens;
+    std::vector<token_kind_t> kinds;
+    size_t count = 0;
+
+    // new buffers, so the tokens are reserved up front
+    auto fresh = best_ms([&] {
+        std::vector<std::string_view> t;
+        std::vector<token_kind_t> k;
+        cozy::detail::semantic_tokenize(span, t, k);
+        count += t.size();
+    });
+    // buffers kept from the last call, as with a parse_context_t
+    auto reused = best_ms([&] {
+        cozy::detail::semantic_tokenize(span, tokens, kinds);
+        count += tokens.size();
+    });
+
+    std::printf("fresh buffers:  %6.2f ms, %5.2f ns per argument\n", fresh,
+                fresh * 1e6 / n);
+    std::printf("reused buffers: %6.2f ms, %5.2f ns per argument\n", reused,
+                reused * 1e6 / n);
+    return count == 0;
+}
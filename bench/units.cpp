@@ -0,0 +1,76 @@
+// Parsing of durations and byte sizes, against a std::regex based parser
+// as the baseline.
+// g++ -std=c++23 -O2 -I. bench/units.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <regex>
+#include <string>
+#include <vector>
+
+template <typename F>
+double ns_per_value(const std::vector<std::string>& values, F parse)
+{
+    double best = 1e300;
+    for(int run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(auto& s : values)
+            parse(s);
+        std::chrono::duration<double, std::nano> t =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, t.count() / values.size());
+    }
+    return best;
+}
+
+int main()
+{
+    constexpr size_t n = 1'000'000;
+    const char* duration_forms[] = {"250ms", "2h30m", "1.5s", "90", "3d"};
+    const char* size_forms[] = {"64MiB", "1.5G", "4096", "512k", "2TiB"};
+    std::vector<std::string> durations, sizes;
+    for(size_t i = 0; i < n; i++)
+    {
+        durations.push_back(duration_forms[i % 5]);
+        sizes.push_back(size_forms[i % 5]);
+    }
+
+    using ms = std::chrono::milliseconds;
+    for(size_t i = 0; i < 5; i++)
+    {
+        ms x;
+        cozy::byte_size y;
+        if(!cozy::parser_traits<ms>::parse(duration_forms[i], &x) ||
+           !cozy::parser_traits<cozy::byte_size>::parse(size_forms[i], &y))
+            return 1;
+    }
+
+    int64_t sum = 0;
+    auto duration = ns_per_value(durations, [&](const std::string& s) {
+        ms x;
+        if(cozy::parser_traits<ms>::parse(s, &x))
+            sum += x.count();
+    });
+    auto size = ns_per_value(sizes, [&](const std::string& s) {
+        cozy::byte_size x;
+        if(cozy::parser_traits<cozy::byte_size>::parse(s, &x))
+            sum += x.bytes;
+    });
+
+    // A number and a unit per match, the kind of helper this replaces. Only
+    // the matching is timed, not the unit lookup.
+    std::regex part{R"(([0-9]+(?:\.[0-9]*)?)([a-zA-Z]*))"};
+    auto regex = ns_per_value(durations, [&](const std::string& s) {
+        for(std::sregex_iterator it{s.begin(), s.end(), part}, end; it != end;
+            ++it)
+            sum += static_cast<int64_t>(std::stod((*it)[1].str()));
+    });
+
+    std::printf("duration:   %6.1f ns per value\n", duration);
+    std::printf("byte_size:  %6.1f ns per value\n", size);
+    std::printf("std::regex: %6.1f ns per duration\n", regex);
+    return sum == 0;
+}
@@ -3,19 +3,37 @@
 #include "typestring/typestring.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
 #include <charconv>
+#include <chrono>
+#include <cmath>
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <expected>
 #include <format>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <new>
 #include <numeric>
 #include <ranges>
 #include <span>
 #include <stdexcept>
 #include <string_view>
+#include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#endif
+
 namespace cozy
 {
     using namespace std::literals;
@@ -23,6 +41,39 @@ namespace cozy
     template <typename T>
     using expected = std::expected<T, std::string>;
 
+    namespace detail
+    {
+        enum class flag_kind_t
+        {
+            single,
+            boolean,
+            variable,
+        };
+    } // namespace detail
+
+    // Specialize parser_traits to use T as a flag target, with members
+    //  static constexpr parse_arg_t::flag_kind_t kind;
+    //  static expected<bool> parse(std::string_view token, T* target);
+    //  static constexpr std::span<const std::string_view> choices; // optional
+    //  static expected<void> validate(T* target); // optional
+    // A single flag passes its value to parse.
+    // A boolean flag passes the value after '=', or a null token if there is
+    // none.
+    // A variable flag passes each value and returns true to take more, then
+    // a null token at the end of the flag.
+    // parse may also return expected<void>, meaning it takes no more values.
+    // Types of the single kind can also be elements of containers and maps.
+    template <typename T>
+    struct parser_traits;
+
+    // Specialize enum_traits to use the enum E as a flag target, with members
+    //  static constexpr std::pair<std::string_view, E> names[];
+    //  static constexpr bool flags = true; // optional
+    // A value is one of the names. If flags is true, E is a bit-flag enum and
+    // a value can also be several names joined by '|', e.g. read|write.
+    template <typename E>
+    struct enum_traits;
+
     namespace detail
     {
         inline constexpr bool invalid_name(std::string_view name)
@@ -41,17 +92,55 @@ namespace cozy
             is_in<T, std::string_view, std::string, bool> ||
             std::is_integral_v<T> || std::is_floating_point_v<T>;
 
+        template <typename T>
+        concept user_parseable = !single_parseable<T> && requires(T x) {
+            {
+                parser_traits<T>::kind
+            } -> std::convertible_to<flag_kind_t>;
+            parser_traits<T>::parse(std::string_view{}, &x);
+        };
+
+        // Types that can be elements of containers and maps
+        template <typename T>
+        concept element_parseable =
+            single_parseable<T> ||
+            (user_parseable<T> && parser_traits<T>::kind == flag_kind_t::single);
+
+        // Containers with a fixed capacity, e.g. std::inplace_vector, signal
+        // being full by returning nullptr from try_push_back.
+        template <typename T>
+        concept fixed_capacity_container = requires(T x) {
+            {
+                x.try_push_back(std::declval<typename T::value_type>())
+            } -> std::convertible_to<const typename T::value_type*>;
+            {
+                x.capacity()
+            } -> std::convertible_to<size_t>;
+        };
+
         template <typename T>
         concept parseable_container = requires(T x) {
             typename T::value_type;
             requires !is_in<T, std::string, std::string_view>;
-            requires single_parseable<typename T::value_type>;
+            requires !user_parseable<T>;
+            requires element_parseable<typename T::value_type>;
             requires std::is_default_constructible_v<typename T::value_type>;
-            {
-                x.push_back(std::declval<typename T::value_type>())
+            requires fixed_capacity_container<T> || requires {
+                x.push_back(std::declval<typename T::value_type>());
             };
         };
 
+        template <typename T>
+        concept parseable_map = requires(T x) {
+            typename T::key_type;
+            typename T::mapped_type;
+            requires !user_parseable<T>;
+            requires element_parseable<typename T::key_type>;
+            requires element_parseable<typename T::mapped_type>;
+            x.insert_or_assign(std::declval<typename T::key_type>(),
+                               std::declval<typename T::mapped_type>());
+        };
+
         template <typename T>
             requires std::is_integral_v<T>
         expected<bool> builtin_parse(std::string_view s, T* target)
@@ -117,6 +206,160 @@ namespace cozy
             return false;
         }
 
+        template <user_parseable T>
+        expected<bool> builtin_parse(std::string_view s, T* target)
+        {
+            using result_t = decltype(parser_traits<T>::parse(s, target));
+            if constexpr(std::is_same_v<result_t, expected<void>>)
+            {
+                auto result = parser_traits<T>::parse(s, target);
+                if(!result)
+                    return std::unexpected{std::move(result.error())};
+                return false;
+            }
+            else
+                return parser_traits<T>::parse(s, target);
+        }
+
+        // A non-negative decimal number equal to mantissa / scale,
+        // where scale is a power of 10.
+        struct decimal_t
+        {
+            uint64_t mantissa;
+            uint64_t scale;
+        };
+
+        // Parses digits with an optional fraction from the start of
+        // [first, last). Returns the end of the number, or nullptr if there
+        // is none or it has too many digits.
+        inline const char* parse_decimal(const char* first, const char* last,
+                                         decimal_t& d)
+        {
+            static constexpr uint64_t pow10[] = {
+                1,
+                10,
+                100,
+                1'000,
+                10'000,
+                100'000,
+                1'000'000,
+                10'000'000,
+                100'000'000,
+                1'000'000'000,
+                10'000'000'000,
+                100'000'000'000,
+                1'000'000'000'000,
+                10'000'000'000'000,
+                100'000'000'000'000,
+                1'000'000'000'000'000,
+                10'000'000'000'000'000,
+                100'000'000'000'000'000,
+                1'000'000'000'000'000'000,
+                10'000'000'000'000'000'000u,
+            };
+
+            d = {.mantissa = 0, .scale = 1};
+            auto [ptr, ec] = std::from_chars(first, last, d.mantissa);
+            if(ec != std::errc())
+                return nullptr;
+            if(ptr == last || *ptr != '.')
+                return ptr;
+
+            auto frac_first = ptr + 1;
+            uint64_t frac = 0;
+            auto [frac_last, frac_ec] = std::from_chars(frac_first, last, frac);
+            if(frac_ec != std::errc() ||
+               frac_last - frac_first >= std::ssize(pow10))
+                return nullptr;
+
+            d.scale = pow10[frac_last - frac_first];
+            if(d.mantissa > (UINT64_MAX - frac) / d.scale)
+                return nullptr;
+            d.mantissa = d.mantissa * d.scale + frac;
+            return frac_last;
+        }
+
+        // Computes d * num / den truncated toward zero, false on overflow.
+        template <typename Rep>
+        bool scale_decimal(decimal_t d, uint64_t num, uint64_t den, Rep& out)
+        {
+            static constexpr auto max = std::numeric_limits<Rep>::max();
+            if(std::is_integral_v<Rep> && d.scale == 1)
+            {
+                if(num != 0 && d.mantissa > UINT64_MAX / num)
+                    return false;
+                auto x = d.mantissa * num / den;
+                if(x > uint64_t(max))
+                    return false;
+                out = Rep(x);
+                return true;
+            }
+
+            auto x = (long double)d.mantissa * num / den / d.scale;
+            if(x > (long double)max)
+                return false;
+            out = Rep(x);
+            return true;
+        }
+
+        // Returns a duration unit as a fraction of seconds, {0, 0} if unknown.
+        inline constexpr std::pair<uint64_t, uint64_t>
+        duration_unit(std::string_view unit)
+        {
+            switch(unit.size())
+            {
+            case 1:
+                switch(unit[0])
+                {
+                case 's': return {1, 1};
+                case 'm': return {60, 1};
+                case 'h': return {3600, 1};
+                case 'd': return {86400, 1};
+                }
+                break;
+            case 2:
+                if(unit[1] != 's')
+                    break;
+                switch(unit[0])
+                {
+                case 'n': return {1, 1'000'000'000};
+                case 'u': return {1, 1'000'000};
+                case 'm': return {1, 1'000};
+                }
+                break;
+            case 3:
+                if(unit == "min"sv)
+                    return {60, 1};
+                if(unit == "\xc2\xb5s"sv) // µs in UTF-8
+                    return {1, 1'000'000};
+                break;
+            }
+            return {0, 0};
+        }
+
+        // Returns a byte size suffix as a multiplier, 0 if unknown.
+        inline constexpr uint64_t byte_unit(std::string_view unit)
+        {
+            if(unit.empty() || unit == "B"sv)
+                return 1;
+
+            auto pos = "KMGTPE"sv.find(unit[0] == 'k' ? 'K' : unit[0]);
+            if(pos == std::string_view::npos)
+                return 0;
+
+            auto suffix = unit.substr(1);
+            if(suffix.empty() || suffix == "iB"sv)
+                return uint64_t(1) << (10 * (pos + 1));
+            if(suffix == "B"sv)
+            {
+                uint64_t x = 1;
+                for(size_t i = 0; i <= pos; i++)
+                    x *= 1000;
+                return x;
+            }
+            return 0;
+        }
+
         template <parseable_container T>
         expected<bool> builtin_parse_container(std::string_view s, T* target)
         {
@@ -127,15 +370,234 @@ namespace cozy
             auto result = builtin_parse(s, &v);
             if(!result)
                 return result;
-            target->push_back(std::move(v));
+
+            if constexpr(fixed_capacity_container<T>)
+            {
+                if(!target->try_push_back(std::move(v)))
+                    return std::unexpected{
+                        std::format("cannot take {}, at most {} values allowed",
+                                    s, target->capacity())};
+            }
+            else
+                target->push_back(std::move(v));
+
+            return true;
+        }
+
+        // Parses key=value, split at the first '='.
+        // Repeated keys keep the last value.
+        template <parseable_map T>
+        expected<bool> builtin_parse_map(std::string_view s, T* target)
+        {
+            if(s.data() == nullptr)
+                return false;
+
+            auto equal_pos = s.find('=');
+            if(equal_pos == s.npos)
+                return std::unexpected{
+                    std::format("missing = in {}, expected key=value", s)};
+
+            typename T::key_type k;
+            typename T::mapped_type v;
+            auto result = builtin_parse(s.substr(0, equal_pos), &k);
+            if(!result)
+                return result;
+            result = builtin_parse(s.substr(equal_pos + 1), &v);
+            if(!result)
+                return result;
+            target->insert_or_assign(std::move(k), std::move(v));
 
             return true;
         }
 
+        // Reserves for n more elements, growing geometrically so that
+        // reserving before each small batch doesn't reallocate every time.
+        template <typename T>
+        void reserve_more(T* target, size_t n)
+        {
+            auto size = target->size() + n;
+            if constexpr(requires {
+                             target->reserve(n);
+                             target->capacity();
+                         })
+            {
+                if(size > target->capacity())
+                    target->reserve(std::max(size, 2 * target->capacity()));
+            }
+            else if constexpr(requires {
+                                  target->reserve(n);
+                                  target->bucket_count();
+                              })
+            {
+                if(size > target->bucket_count() * target->max_load_factor())
+                    target->reserve(std::max(size, 2 * target->size()));
+            }
+        }
+
+        template <typename T>
+        std::shared_ptr<const void> snapshot_of(const void* target)
+        {
+            return std::make_shared<const T>(*static_cast<const T*>(target));
+        }
+
+        // Assigning reuses the capacity of the target.
+        template <typename T>
+        void restore_from(void* target, const void* snapshot)
+        {
+            auto t = static_cast<T*>(target);
+            auto& value = *static_cast<const T*>(snapshot);
+            if constexpr(requires { t->clear(); })
+            {
+                if(std::ranges::empty(value))
+                {
+                    t->clear();
+                    return;
+                }
+            }
+            *t = value;
+        }
+
+        // Reserves for n more chars of the strings of target, e.g. a
+        // string_list, growing geometrically like reserve_more.
+        template <typename T>
+        void reserve_more_chars(T* target, size_t n)
+        {
+            if constexpr(requires { target->reserve_chars(n); })
+            {
+                auto size = target->chars() + n;
+                if(size > target->chars_capacity())
+                    target->reserve_chars(
+                        std::max(size, 2 * target->chars_capacity()));
+            }
+        }
+
+        // Parses every delimiter separated piece of s as an element.
+        template <parseable_container T>
+        expected<bool> builtin_parse_split(std::string_view s, char delimiter,
+                                           T* target)
+        {
+            if(s.data() == nullptr)
+                return false;
+
+            reserve_more(target, std::ranges::count(s, delimiter) + 1);
+            reserve_more_chars(target, s.size());
+
+            auto first = s.data(), last = s.data() + s.size();
+            while(true)
+            {
+                auto pos = static_cast<const char*>(
+                    std::memchr(first, delimiter, last - first));
+                auto result = builtin_parse_container(
+                    std::string_view{first, pos ? pos : last}, target);
+                if(!result)
+                    return result;
+                if(!pos)
+                    return true;
+                first = pos + 1;
+            }
+        }
+
+        // Writes the text of values to data, or only counts its length if data
+        // is nullptr, so that the length of a dump is computed exactly by the
+        // same code that writes it.
+        struct dump_writer_t
+        {
+            void put(std::string_view s)
+            {
+                if(data && !s.empty())
+                    std::memcpy(data + size, s.data(), s.size());
+                size += s.size();
+            }
+
+            void put(char c)
+            {
+                if(data)
+                    data[size] = c;
+                size++;
+            }
+
+            template <typename T>
+            void number(T x)
+            {
+                char buf[64];
+                auto end = std::to_chars(buf, std::end(buf), x).ptr;
+                put({buf, end});
+            }
+
+            // Quoted and escaped in JSON. Otherwise only if it has control
+            // chars, quotes or backslashes, so that each flag stays on one
+            // line, or blanks, ',' or '=', so that it stays one element.
+            void string(std::string_view s)
+            {
+                if(!json && std::ranges::none_of(s, [](char c) {
+                       return static_cast<unsigned char>(c) <= 0x20 ||
+                              c == '"' || c == '\\' || c == ',' || c == '=';
+                   }))
+                    return put(s);
+
+                static constexpr char hex[] = "0123456789abcdef";
+                put('"');
+                auto first = s.begin();
+                for(auto it = s.begin(); it != s.end(); ++it)
+                {
+                    auto c = static_cast<unsigned char>(*it);
+                    if(c >= 0x20 && c != '"' && c != '\\')
+                        continue;
+                    put({first, it});
+                    first = it + 1;
+                    if(c == '"' || c == '\\')
+                    {
+                        put('\\');
+                        put(char(c));
+                    }
+                    else
+                    {
+                        put("\\u00"sv);
+                        put(hex[c >> 4]);
+                        put(hex[c & 15]);
+                    }
+                }
+                put({first, s.end()});
+                put('"');
+            }
+
+            char* data = nullptr;
+            size_t size = 0;
+            bool json = false;
+        };
+
+        // Operations a handle optionally supports, nullptr if it doesn't.
+        struct handle_ops_t
+        {
+            flag_kind_t kind = flag_kind_t::variable;
+            // Values the target accepts, if it only accepts a fixed set of them.
+            std::span<const std::string_view> choices = {};
+            // Hints that n more values are about to be parsed.
+            void (*reserve)(void* target, size_t n) = nullptr;
+            // Hints that values of n chars in total are about to be parsed.
+            void (*reserve_chars)(void* target, size_t n) = nullptr;
+            expected<bool> (*split)(std::string_view token, char delimiter,
+                                    void* target) = nullptr;
+            // Checks a target whose conversion was deferred.
+            expected<void> (*validate)(void* target) = nullptr;
+            // Targets are reset to their defaults by copying back
+            // trivial_size bytes if it isn't 0, otherwise by restoring a
+            // snapshot.
+            size_t trivial_size = 0;
+            std::shared_ptr<const void> (*snapshot)(const void* target) =
+                nullptr;
+            void (*restore)(void* target, const void* snapshot) = nullptr;
+            uint64_t (*hash)(const void* target) = nullptr;
+            void (*dump)(const void* target, dump_writer_t& out) = nullptr;
+            // Same as the call, moving source into the target.
+            expected<bool> (*consume)(std::string& source,
+                                      void* target) = nullptr;
+        };
+
         struct parse_handle_t
         {
             // parse_handle_t exists because std::function is 64 bytes
-            // as opposed to 16 bytes
+            // as opposed to 24 bytes
             expected<bool> operator()(std::string_view token)
             {
                 return call(token, target);
@@ -143,6 +605,7 @@ namespace cozy
 
             void* target;
             expected<bool> (*call)(std::string_view, void*);
+            const handle_ops_t* ops = nullptr;
         };
 
         struct parse_visitor_t
@@ -171,16 +634,30 @@ namespace cozy
             flag,
         };
 
-        template <std::convertible_to<std::string_view> String>
-        inline auto semantic_tokenize(std::span<String> args)
+        // Replaces the contents of tokens and kinds.
+        template <std::ranges::input_range Args>
+            requires std::convertible_to<std::ranges::range_reference_t<Args>,
+                                         std::string_view>
+        inline void semantic_tokenize(Args&& args,
+                                      std::vector<std::string_view>& tokens,
+                                      std::vector<token_kind_t>& kinds)
         {
-            auto ret = std::pair{std::vector<std::string_view>{},
-                                 std::vector<token_kind_t>{}};
-            auto& [tokens, kinds] = ret;
+            tokens.clear();
+            kinds.clear();
+            // Most arguments are one token, so this is usually the only
+            // reservation. Classifying the arguments several at a time
+            // doesn't pay off, as the first chars of each are loaded from
+            // separate strings either way.
+            if constexpr(std::ranges::sized_range<Args>)
+            {
+                tokens.reserve(std::ranges::size(args));
+                kinds.reserve(std::ranges::size(args));
+            }
 
-            for(size_t i = 0; i < args.size(); i++)
+            auto last = std::ranges::end(args);
+            for(auto it = std::ranges::begin(args); it != last; ++it)
             {
-                std::string_view token = args[i];
+                std::string_view token = *it;
                 if(!token.starts_with('-') || token.size() < 2)
                 {
                     tokens.push_back(token);
@@ -190,11 +667,12 @@ namespace cozy
 
                 if(token == "--"sv)
                 {
-                    tokens.insert(tokens.end(), args.begin() + i + 1,
-                                  args.end());
-                    kinds.insert(kinds.end(), args.size() - i - 1,
-                                 token_kind_t::literal);
-                    return ret;
+                    for(++it; it != last; ++it)
+                    {
+                        tokens.push_back(*it);
+                        kinds.push_back(token_kind_t::literal);
+                    }
+                    return;
                 }
 
                 auto equal_pos = token.find('=');
@@ -219,8 +697,180 @@ namespace cozy
                     kinds.push_back(token_kind_t::arg);
                 }
             }
+        }
+
+        template <std::convertible_to<std::string_view> String>
+        inline auto semantic_tokenize(std::span<String> args)
+        {
+            auto ret = std::pair{std::vector<std::string_view>{},
+                                 std::vector<token_kind_t>{}};
+            semantic_tokenize(args, ret.first, ret.second);
             return ret;
         }
+
+        // Compact trie over flag names.
+        // Every node covers a contiguous range of the names in sorted order
+        // and the children of a node are stored contiguously, so both exact
+        // and prefix lookups walk one small array per character.
+        class flag_index_t
+        {
+          public:
+            static constexpr uint32_t npos = -1;
+
+            struct match_t
+            {
+                // exact is the first flag named exactly as the query, or npos
+                uint32_t exact = npos;
+                // indices of all flags starting with the query, sorted by name
+                std::span<const uint32_t> candidates;
+            };
+
+            // name_of(i) returns the name of the i-th flag.
+            template <typename F>
+            void build(size_t n, F name_of);
+
+            [[nodiscard]] match_t find(std::string_view prefix) const;
+
+            // Indices of all flags sorted by name.
+            [[nodiscard]] std::span<const uint32_t> sorted() const
+            {
+                return order;
+            }
+
+          private:
+            struct node_t
+            {
+                uint32_t lo, hi;
+                uint32_t first_child;
+                uint32_t exact;
+                uint16_t children;
+                char c;
+            };
+
+            std::vector<node_t> nodes;
+            std::vector<uint32_t> order;
+        };
+
+        template <typename F>
+        void flag_index_t::build(size_t n, F name_of)
+        {
+            order.resize(n);
+            std::iota(order.begin(), order.end(), uint32_t{0});
+            // stable so that the first registered of equal names is the exact
+            // match, same as a linear scan would find
+            std::ranges::stable_sort(order, {}, name_of);
+
+            nodes.clear();
+            nodes.push_back({.lo = 0,
+                             .hi = uint32_t(n),
+                             .first_child = 0,
+                             .exact = npos,
+                             .children = 0,
+                             .c = 0});
+
+            // Breadth first, so the children of each node are appended
+            // next to each other. depths[k] is the prefix length of nodes[k].
+            std::vector<uint32_t> depths{0};
+            for(size_t k = 0; k < nodes.size(); k++)
+            {
+                auto depth = depths[k];
+                auto i = nodes[k].lo, hi = nodes[k].hi;
+
+                if(i < hi && name_of(order[i]).size() == depth)
+                {
+                    nodes[k].exact = order[i];
+                    while(i < hi && name_of(order[i]).size() == depth)
+                        i++;
+                }
+
+                nodes[k].first_child = uint32_t(nodes.size());
+                while(i < hi)
+                {
+                    auto c = name_of(order[i])[depth];
+                    auto j = i + 1;
+                    while(j < hi && name_of(order[j])[depth] == c)
+                        j++;
+
+                    nodes.push_back({.lo = i,
+                                     .hi = j,
+                                     .first_child = 0,
+                                     .exact = npos,
+                                     .children = 0,
+                                     .c = c});
+                    depths.push_back(depth + 1);
+                    nodes[k].children++;
+                    i = j;
+                }
+            }
+        }
+
+        inline auto flag_index_t::find(std::string_view prefix) const
+            -> match_t
+        {
+            if(nodes.empty())
+                return {};
+
+            const node_t* node = &nodes[0];
+            for(auto c : prefix)
+            {
+                auto first = nodes.begin() + node->first_child;
+                auto last = first + node->children;
+                auto it = std::find_if(first, last,
+                                       [c](auto& x) { return x.c == c; });
+                if(it == last)
+                    return {};
+                node = &*it;
+            }
+
+            return {.exact = node->exact,
+                    .candidates = std::span{order}.subspan(
+                        node->lo, node->hi - node->lo)};
+        }
+
+        // A set of flag indices, stored as the nonzero words of a bitset so
+        // that checking it against another bitset is a few word operations.
+        class flag_set_t
+        {
+          public:
+            void insert(uint32_t i)
+            {
+                auto it = std::ranges::lower_bound(
+                    words, i / 64, {}, &std::pair<uint32_t, uint64_t>::first);
+                if(it == words.end() || it->first != i / 64)
+                    it = words.insert(it, {i / 64, 0});
+                it->second |= uint64_t(1) << (i % 64);
+            }
+
+            // Number of flags in both this and bits.
+            size_t count_in(std::span<const uint64_t> bits) const
+            {
+                size_t n = 0;
+                for(auto [word, mask] : words)
+                    n += std::popcount(bits[word] & mask);
+                return n;
+            }
+
+            bool all_in(std::span<const uint64_t> bits) const
+            {
+                return std::ranges::all_of(words, [bits](auto x) {
+                    return (bits[x.first] & x.second) == x.second;
+                });
+            }
+
+            // Calls f with the index of each flag in both this and bits, or
+            // in this but not bits if in is false.
+            template <bool in = true, typename F>
+            void for_each(std::span<const uint64_t> bits, F f) const
+            {
+                for(auto [word, mask] : words)
+                    for(auto m = mask & (in ? bits[word] : ~bits[word]); m;
+                        m &= m - 1)
+                        f(word * 64 + std::countr_zero(m));
+            }
+
+          private:
+            std::vector<std::pair<uint32_t, uint64_t>> words;
+        };
     } // namespace detail
 
     struct flag_name_t
@@ -245,81 +895,2161 @@ namespace cozy
         std::string_view str;
     };
 
-    template <typename T>
-    concept builtin_parseable =
-        detail::single_parseable<T> || detail::parseable_container<T>;
-
-    struct parse_arg_t
+    // A vector with its elements stored inline, up to a capacity of N.
+    // Parsing more than N values into it is an error.
+    template <typename T, size_t N>
+        requires std::is_default_constructible_v<T>
+    class inplace_vector
     {
-        enum flag_kind_t
-        {
-            single,
-            boolean,
-            variable,
-        };
+      public:
+        using value_type = T;
+        using size_type = size_t;
+        using iterator = T*;
+        using const_iterator = const T*;
 
-        auto operator()(std::string_view token)
+        static constexpr size_t capacity() { return N; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        T* data() { return elems; }
+        const T* data() const { return elems; }
+        T* begin() { return elems; }
+        const T* begin() const { return elems; }
+        T* end() { return elems + count; }
+        const T* end() const { return elems + count; }
+        T& operator[](size_t i) { return elems[i]; }
+        const T& operator[](size_t i) const { return elems[i]; }
+
+        // Returns nullptr if full.
+        T* try_push_back(T x)
         {
-            return std::visit(detail::parse_visitor_t{token}, target);
+            if(count == N)
+                return nullptr;
+            elems[count] = std::move(x);
+            return &elems[count++];
         }
 
-        using parseable_t =
-            std::variant<bool*, char*, unsigned char*, signed char*, short*,
-                         unsigned short*, int*, unsigned int*, long*,
-                         unsigned long*, long long*, unsigned long long*,
-                         float*, double*, long double*, std::string*,
-                         std::string_view*, detail::parse_handle_t>;
-        // TODO: differentiate user vs built-in function for flag_kind for user
-        // extensions
-
-        flag_kind_t kind() const
+        void push_back(T x)
         {
-            switch(target.index())
-            {
-            case 0: return boolean;
-            case std::variant_size_v<parseable_t> - 1: return variable;
-            default: return single;
-            }
+            if(!try_push_back(std::move(x)))
+                throw std::bad_alloc{};
         }
 
-        parseable_t target;
+        void pop_back() { count--; }
+        void clear() { count = 0; }
+
+      private:
+        T elems[N]{};
+        size_t count = 0;
     };
 
-    template <detail::single_parseable T>
-    inline parse_arg_t make_parse_arg(T& target)
+    // A vector over user provided storage, e.g. a std::array.
+    // Parsing more values than the storage holds is an error.
+    template <typename T>
+    class bounded_span
     {
-        return parse_arg_t{.target = &target};
+      public:
+        using value_type = T;
+        using size_type = size_t;
+        using iterator = T*;
+        using const_iterator = const T*;
+
+        bounded_span(std::span<T> storage, size_t size = 0)
+            : storage{storage}, count{size}
+        {
+        }
+
+        template <size_t N>
+        bounded_span(std::array<T, N>& storage, size_t size = 0)
+            : storage{storage}, count{size}
+        {
+        }
+
+        size_t capacity() const { return storage.size(); }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        T* data() const { return storage.data(); }
+        T* begin() const { return storage.data(); }
+        T* end() const { return storage.data() + count; }
+        T& operator[](size_t i) const { return storage[i]; }
+
+        // Returns nullptr if full.
+        T* try_push_back(T x)
+        {
+            if(count == storage.size())
+                return nullptr;
+            storage[count] = std::move(x);
+            return &storage[count++];
+        }
+
+        void push_back(T x)
+        {
+            if(!try_push_back(std::move(x)))
+                throw std::bad_alloc{};
+        }
+
+        void pop_back() { count--; }
+        void clear() { count = 0; }
+
+      private:
+        std::span<T> storage;
+        size_t count;
+    };
+
+    template <typename T, size_t N>
+    bounded_span(std::array<T, N>&, size_t = 0) -> bounded_span<T>;
+
+    // A list of strings stored back to back in one buffer, with the end of
+    // each string in an array of offsets. Appending a string only allocates
+    // when a buffer grows, as opposed to once per std::string.
+    // std::vector<std::string_view> is the zero-copy alternative, viewing
+    // the arguments themselves.
+    class string_list
+    {
+      public:
+        using value_type = std::string_view;
+        using size_type = size_t;
+
+        class iterator
+        {
+          public:
+            using iterator_concept = std::random_access_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = ptrdiff_t;
+
+            iterator() = default;
+            iterator(const string_list* list, size_t i) : list{list}, i{i} {}
+
+            std::string_view operator*() const { return (*list)[i]; }
+            std::string_view operator[](difference_type n) const
+            {
+                return (*list)[i + n];
+            }
+
+            iterator& operator++() { return *this += 1; }
+            iterator& operator--() { return *this -= 1; }
+            iterator operator++(int) { return std::exchange(*this, *this + 1); }
+            iterator operator--(int) { return std::exchange(*this, *this - 1); }
+            iterator& operator+=(difference_type n)
+            {
+                i += n;
+                return *this;
+            }
+            iterator& operator-=(difference_type n) { return *this += -n; }
+
+            friend iterator operator+(iterator it, difference_type n)
+            {
+                return it += n;
+            }
+            friend iterator operator+(difference_type n, iterator it)
+            {
+                return it += n;
+            }
+            friend iterator operator-(iterator it, difference_type n)
+            {
+                return it -= n;
+            }
+            friend difference_type operator-(iterator a, iterator b)
+            {
+                return difference_type(a.i - b.i);
+            }
+
+            bool operator==(const iterator& other) const { return i == other.i; }
+            auto operator<=>(const iterator& other) const { return i <=> other.i; }
+
+          private:
+            const string_list* list = nullptr;
+            size_t i = 0;
+        };
+        using const_iterator = iterator;
+
+        size_t size() const { return ends.size(); }
+        bool empty() const { return ends.empty(); }
+        size_t capacity() const { return ends.capacity(); }
+
+        // The total length of the strings.
+        size_t chars() const { return blob.size(); }
+        size_t chars_capacity() const { return blob.capacity(); }
+
+        std::string_view operator[](size_t i) const
+        {
+            auto first = i == 0 ? 0 : ends[i - 1];
+            return {blob.data() + first, ends[i] - first};
+        }
+
+        std::string_view front() const { return (*this)[0]; }
+        std::string_view back() const { return (*this)[size() - 1]; }
+        iterator begin() const { return {this, 0}; }
+        iterator end() const { return {this, size()}; }
+
+        void reserve(size_t n) { ends.reserve(n); }
+        void reserve_chars(size_t n) { blob.reserve(n); }
+
+        void push_back(std::string_view s)
+        {
+            blob.append(s);
+            ends.push_back(blob.size());
+        }
+
+        void pop_back()
+        {
+            ends.pop_back();
+            blob.resize(ends.empty() ? 0 : ends.back());
+        }
+
+        void clear()
+        {
+            blob.clear();
+            ends.clear();
+        }
+
+        bool operator==(const string_list&) const = default;
+
+      private:
+        std::string blob;
+        std::vector<size_t> ends;
+    };
+
+    // A number of bytes, parsed from e.g. 512, 64MiB or 1.5G.
+    // K, M, G, T, P, E and their iB forms are powers of 1024, with a B
+    // suffix they are powers of 1000. Fractions of a byte are truncated.
+    struct byte_size
+    {
+        uint64_t bytes = 0;
+
+        auto operator<=>(const byte_size&) const = default;
+    };
+
+    template <>
+    struct parser_traits<byte_size>
+    {
+        static constexpr auto kind = detail::flag_kind_t::single;
+
+        static expected<void> parse(std::string_view s, byte_size* target)
+        {
+            auto last = s.data() + s.size();
+            detail::decimal_t d;
+            auto ptr = detail::parse_decimal(s.data(), last, d);
+            if(!ptr)
+                return std::unexpected{
+                    std::format("cannot parse {} as byte size", s)};
+
+            auto unit = detail::byte_unit({ptr, last});
+            if(unit == 0)
+                return std::unexpected{
+                    std::format("cannot parse {} as byte size", s)};
+            if(!detail::scale_decimal(d, unit, 1, target->bytes))
+                return std::unexpected{
+                    std::format("{} is too large for byte size", s)};
+            return {};
+        }
+    };
+
+    // Parsed from a sequence of numbers each followed by a unit, e.g. 250ms,
+    // 1.5s or 2h30m, or a bare number counting Period.
+    // Units are ns, us, ms, s, m or min, h and d. The total is truncated
+    // toward zero to Period, like std::chrono::duration_cast.
+    template <typename Rep, typename Period>
+    struct parser_traits<std::chrono::duration<Rep, Period>>
+    {
+        static constexpr auto kind = detail::flag_kind_t::single;
+
+        static expected<void> parse(std::string_view s,
+                                    std::chrono::duration<Rep, Period>* target)
+        {
+            auto error = [s] {
+                return std::unexpected{std::format(
+                    "cannot parse {} as {}", s,
+                    typestring::name<std::chrono::duration<Rep, Period>>)};
+            };
+            auto out_of_range = [s] {
+                return std::unexpected{std::format(
+                    "{} is out of range for {}", s,
+                    typestring::name<std::chrono::duration<Rep, Period>>)};
+            };
+
+            auto first = s.data(), last = s.data() + s.size();
+            bool negative = std::is_signed_v<Rep> && s.starts_with('-');
+            first += negative;
+            if(first == last)
+                return error();
+
+            Rep total = 0;
+            while(first != last)
+            {
+                detail::decimal_t d;
+                auto ptr = detail::parse_decimal(first, last, d);
+                if(!ptr)
+                    return error();
+                auto unit_last = std::find_if(ptr, last, [](char c) {
+                    return c == '.' || (c >= '0' && c <= '9');
+                });
+
+                // a bare number counts Period
+                uint64_t num = 1, den = 1;
+                if(ptr != unit_last)
+                {
+                    // seconds per unit divided by seconds per Period
+                    auto [unit_num, unit_den] =
+                        detail::duration_unit({ptr, unit_last});
+                    if(unit_num == 0)
+                        return error();
+                    auto a = std::gcd(unit_num, uint64_t(Period::num));
+                    auto b = std::gcd(uint64_t(Period::den), unit_den);
+                    num = unit_num / a;
+                    den = unit_den / b;
+                    if(Period::den / b > UINT64_MAX / num ||
+                       Period::num / a > UINT64_MAX / den)
+                        return out_of_range();
+                    num *= Period::den / b;
+                    den *= Period::num / a;
+                }
+                else if(first != s.data() + negative || ptr != last)
+                    return error();
+
+                Rep part;
+                if(!detail::scale_decimal(d, num, den, part) ||
+                   (std::is_integral_v<Rep> &&
+                    part > std::numeric_limits<Rep>::max() - total))
+                    return out_of_range();
+                total += part;
+                first = unit_last;
+            }
+
+            *target = std::chrono::duration<Rep, Period>{negative ? -total
+                                                                  : total};
+            return {};
+        }
+    };
+
+    namespace detail
+    {
+        template <typename E>
+        concept named_enum = std::is_enum_v<E> && requires {
+            {
+                std::size(enum_traits<E>::names)
+            } -> std::convertible_to<size_t>;
+        };
+
+        inline constexpr uint32_t enum_hash(std::string_view s, uint32_t seed)
+        {
+            uint32_t h = 2166136261u ^ seed;
+            for(auto c : s)
+            {
+                h ^= uint8_t(c);
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        // A perfect hash of the names of E, searched for at compile time.
+        // Every name hashes to its own slot, so a lookup is one hash and one
+        // string compare. Enums with too many names for a small table, or
+        // whose names no seed separates, are looked up by binary search of
+        // the sorted names instead.
+        template <named_enum E>
+        struct enum_index_t
+        {
+            static constexpr auto& names = enum_traits<E>::names;
+            static constexpr size_t n = std::size(names);
+            static constexpr int max_bits = 12;
+
+            struct hash_t
+            {
+                uint32_t seed;
+                // 0 if there is no perfect hash
+                int bits;
+            };
+
+            static consteval hash_t find_hash()
+            {
+                // n names are likely to hash to distinct slots once there are
+                // about n * n / 2 of them, fewer slots are rarely worth trying
+                std::array<uint64_t, (size_t(1) << max_bits) / 64> used{};
+                for(int bits = std::max(1, int(std::bit_width(n * n / 2)));
+                    bits <= max_bits; bits++)
+                {
+                    auto mask = (uint32_t(1) << bits) - 1;
+                    for(uint32_t seed = 0; seed < 16; seed++)
+                    {
+                        std::ranges::fill(used, 0);
+                        bool ok = true;
+                        for(size_t i = 0; i < n && ok; i++)
+                        {
+                            auto h = enum_hash(names[i].first, seed) & mask;
+                            auto bit = uint64_t(1) << (h % 64);
+                            ok = !(used[h / 64] & bit);
+                            used[h / 64] |= bit;
+                        }
+                        if(ok)
+                            return {seed, bits};
+                    }
+                }
+                return {0, 0};
+            }
+
+            static constexpr hash_t hash = find_hash();
+            static constexpr bool perfect = hash.bits > 0;
+            static constexpr uint32_t mask = (uint32_t(1) << hash.bits) - 1;
+
+            // index + 1 of the name in each slot, 0 if empty
+            static constexpr auto slots = [] {
+                std::array<uint32_t, perfect ? size_t(1) << hash.bits : 0>
+                    slots{};
+                if constexpr(perfect)
+                    for(size_t i = 0; i < n; i++)
+                        slots[enum_hash(names[i].first, hash.seed) & mask] =
+                            uint32_t(i + 1);
+                return slots;
+            }();
+
+            // indices of the names sorted by name, without a perfect hash
+            static constexpr auto sorted = [] {
+                std::array<uint32_t, perfect ? 0 : n> sorted{};
+                std::iota(sorted.begin(), sorted.end(), uint32_t{0});
+                std::ranges::sort(sorted, {}, [](uint32_t i) {
+                    return std::string_view{names[i].first};
+                });
+                return sorted;
+            }();
+
+            static constexpr auto choices = [] {
+                std::array<std::string_view, n> choices;
+                for(size_t i = 0; i < n; i++)
+                    choices[i] = names[i].first;
+                return choices;
+            }();
+
+            static const E* find(std::string_view name)
+            {
+                if constexpr(perfect)
+                {
+                    auto i = slots[enum_hash(name, hash.seed) & mask];
+                    if(i == 0 || names[i - 1].first != name)
+                        return nullptr;
+                    return &names[i - 1].second;
+                }
+                else
+                {
+                    auto it = std::ranges::lower_bound(
+                        sorted, name, {}, [](uint32_t i) {
+                            return std::string_view{names[i].first};
+                        });
+                    if(it == sorted.end() || names[*it].first != name)
+                        return nullptr;
+                    return &names[*it].second;
+                }
+            }
+        };
+    } // namespace detail
+
+    template <detail::named_enum E>
+    struct parser_traits<E>
+    {
+        static constexpr auto kind = detail::flag_kind_t::single;
+        static constexpr std::span<const std::string_view> choices =
+            detail::enum_index_t<E>::choices;
+
+        static expected<void> parse(std::string_view s, E* target)
+        {
+            using index_t = detail::enum_index_t<E>;
+            if constexpr(requires { requires enum_traits<E>::flags; })
+            {
+                if(s.empty())
+                    return error(s);
+                std::underlying_type_t<E> x = 0;
+                for(auto name : std::views::split(s, '|'))
+                {
+                    auto e = index_t::find(std::string_view{name});
+                    if(!e)
+                        return error(s);
+                    x |= std::to_underlying(*e);
+                }
+                *target = E(x);
+            }
+            else
+            {
+                auto e = index_t::find(s);
+                if(!e)
+                    return error(s);
+                *target = *e;
+            }
+            return {};
+        }
+
+      private:
+        static std::unexpected<std::string> error(std::string_view s)
+        {
+            std::string names;
+            for(auto name : choices)
+                names += std::format(" {}", name);
+            return std::unexpected{
+                std::format("cannot parse {} as {}, expected one of{}", s,
+                            typestring::name<E>, names)};
+        }
+    };
+
+    struct ipv4_address
+    {
+        std::array<uint8_t, 4> bytes{};
+
+        auto operator<=>(const ipv4_address&) const = default;
+    };
+
+    // Parsed from the text form, with :: and a trailing IPv4 address allowed.
+    struct ipv6_address
+    {
+        std::array<uint8_t, 16> bytes{};
+
+        auto operator<=>(const ipv6_address&) const = default;
+    };
+
+    // Parsed from host:port or [ipv6]:port. host refers to the argument, it is
+    // an IPv4 address, an IPv6 address without brackets or a host name.
+    struct endpoint
+    {
+        std::string_view host;
+        uint16_t port = 0;
+
+        auto operator<=>(const endpoint&) const = default;
+    };
+
+    namespace detail
+    {
+        inline constexpr uint64_t swar_ones = 0x0101010101010101;
+        inline constexpr uint64_t swar_high = swar_ones * 0x80;
+
+        // Sets the high bit of each byte of x that is in [lo, lo + n).
+        inline constexpr uint64_t swar_in_range(uint64_t x, uint8_t lo,
+                                                uint8_t n)
+        {
+            // the high bits keep each byte from borrowing its neighbour
+            auto d = (x | swar_high) - swar_ones * lo;
+            auto too_large = (d & ~swar_high) + swar_ones * (0x80 - n);
+            return d & ~too_large & ~x & swar_high;
+        }
+
+        // Packs the high bit of each byte into one bit per byte.
+        inline constexpr uint64_t swar_movemask(uint64_t x)
+        {
+            return ((x >> 7) * 0x0102040810204080) >> 56;
+        }
+
+        // Classifies each char of s, which is at most 64 chars, by setting
+        // its bit in the mask of its class.
+        struct char_masks_t
+        {
+            uint64_t digit, hex, dot, colon;
+        };
+
+        inline char_masks_t classify_chars(std::string_view s)
+        {
+            char buf[64] = {};
+            std::memcpy(buf, s.data(), s.size());
+
+            char_masks_t masks = {};
+            for(size_t i = 0; i * 8 < s.size(); i++)
+            {
+                uint64_t x;
+                std::memcpy(&x, buf + i * 8, 8);
+                if constexpr(std::endian::native == std::endian::big)
+                    x = std::byteswap(x);
+
+                auto digit = swar_in_range(x, '0', 10);
+                auto hex = digit | swar_in_range(x | swar_ones * 0x20, 'a', 6);
+                masks.digit |= swar_movemask(digit) << i * 8;
+                masks.hex |= swar_movemask(hex) << i * 8;
+                masks.dot |= swar_movemask(swar_in_range(x, '.', 1)) << i * 8;
+                masks.colon |= swar_movemask(swar_in_range(x, ':', 1)) << i * 8;
+            }
+            return masks;
+        }
+
+        inline bool parse_ipv4(std::string_view s, uint8_t* out)
+        {
+            if(s.size() < 7 || s.size() > 15)
+                return false;
+
+            auto [digit, hex, dot, colon] = classify_chars(s);
+            auto all = (uint64_t(1) << s.size()) - 1;
+            if((digit | dot) != all || std::popcount(dot) != 3)
+                return false;
+
+            // Octets have 1 to 3 digits, which are weighted by their count
+            // instead of looping over them, since the counts are as good as
+            // random and the branches would mispredict.
+            static constexpr unsigned weights[4][3] = {
+                {0, 0, 0}, {1, 0, 0}, {10, 1, 0}, {100, 10, 1}};
+            char buf[16 + 2] = {};
+            std::memcpy(buf, s.data(), s.size());
+
+            size_t first = 0;
+            bool bad = false;
+            for(int i = 0; i < 4; i++)
+            {
+                size_t last = i < 3 ? std::countr_zero(dot) : s.size();
+                dot &= dot - 1;
+                auto len = last - first;
+                // no leading zeros, as with inet_pton
+                bad |= len - 1 > 2 || (len > 1 && buf[first] == '0');
+                auto& w = weights[std::min<size_t>(len, 3)];
+                unsigned x = w[0] * uint8_t(buf[first] - '0') +
+                             w[1] * uint8_t(buf[first + 1] - '0') +
+                             w[2] * uint8_t(buf[first + 2] - '0');
+                bad |= x > 255;
+                out[i] = uint8_t(x);
+                first = last + 1;
+            }
+            return !bad;
+        }
+
+        inline bool parse_ipv6(std::string_view s, uint8_t* out)
+        {
+            if(s.size() < 2 || s.size() > 45)
+                return false;
+
+            auto [digit, hex, dot, colon] = classify_chars(s);
+            auto all = (uint64_t(1) << s.size()) - 1;
+            if((hex | dot | colon) != all)
+                return false;
+
+            uint16_t groups[8] = {};
+            int n = 0, gap = -1;
+            size_t pos = 0;
+            if(s.starts_with("::"))
+            {
+                gap = 0;
+                pos = 2;
+            }
+
+            while(pos < s.size())
+            {
+                auto rest = colon >> pos;
+                size_t last = rest ? pos + std::countr_zero(rest) : s.size();
+
+                if((dot >> pos) & ((uint64_t(1) << (last - pos)) - 1))
+                {
+                    // a trailing IPv4 address is the last two groups
+                    uint8_t v4[4];
+                    if(last != s.size() || n > 6 ||
+                       !parse_ipv4(s.substr(pos), v4))
+                        return false;
+                    groups[n++] = uint16_t(v4[0] << 8 | v4[1]);
+                    groups[n++] = uint16_t(v4[2] << 8 | v4[3]);
+                    break;
+                }
+
+                if(last == pos || last - pos > 4 || n == 8)
+                    return false;
+                uint16_t x = 0;
+                for(auto j = pos; j < last; j++)
+                {
+                    auto c = s[j] | 0x20;
+                    x = uint16_t(x << 4 | (c <= '9' ? c - '0' : c - 'a' + 10));
+                }
+                groups[n++] = x;
+
+                pos = last;
+                if(pos == s.size())
+                    break;
+                pos++;
+                if(pos < s.size() && s[pos] == ':')
+                {
+                    if(gap >= 0)
+                        return false;
+                    gap = n;
+                    pos++;
+                }
+                else if(pos == s.size())
+                    return false;
+            }
+
+            if(gap < 0 ? n != 8 : n > 7)
+                return false;
+
+            // move the groups after :: to the end
+            if(gap >= 0)
+            {
+                std::copy_backward(groups + gap, groups + n, groups + 8);
+                std::fill(groups + gap, groups + gap + 8 - n, uint16_t(0));
+            }
+            for(int i = 0; i < 8; i++)
+            {
+                out[2 * i] = uint8_t(groups[i] >> 8);
+                out[2 * i + 1] = uint8_t(groups[i]);
+            }
+            return true;
+        }
+
+        inline bool valid_host_name(std::string_view s)
+        {
+            return !s.empty() && s.size() <= 253 &&
+                   std::ranges::all_of(s, [](char c) {
+                       return (c >= 'a' && c <= 'z') ||
+                              (c >= 'A' && c <= 'Z') ||
+                              (c >= '0' && c <= '9') || c == '-' || c == '.';
+                   });
+        }
+    } // namespace detail
+
+    template <>
+    struct parser_traits<ipv4_address>
+    {
+        static constexpr auto kind = detail::flag_kind_t::single;
+
+        static expected<void> parse(std::string_view s, ipv4_address* target)
+        {
+            if(!detail::parse_ipv4(s, target->bytes.data()))
+                return std::unexpected{
+                    std::format("cannot parse {} as IPv4 address", s)};
+            return {};
+        }
+    };
+
+    template <>
+    struct parser_traits<ipv6_address>
+    {
+        static constexpr auto kind = detail::flag_kind_t::single;
+
+        static expected<void> parse(std::string_view s, ipv6_address* target)
+        {
+            if(!detail::parse_ipv6(s, target->bytes.data()))
+                return std::unexpected{
+                    std::format("cannot parse {} as IPv6 address", s)};
+            return {};
+        }
+    };
+
+    template <>
+    struct parser_traits<endpoint>
+    {
+        static constexpr auto kind = detail::flag_kind_t::single;
+
+        static expected<void> parse(std::string_view s, endpoint* target)
+        {
+            auto error = [s] {
+                return std::unexpected{std::format(
+                    "cannot parse {} as endpoint, expected host:port", s)};
+            };
+
+            auto colon_pos = s.rfind(':');
+            if(colon_pos == s.npos)
+                return error();
+            auto host = s.substr(0, colon_pos);
+            auto port = s.substr(colon_pos + 1);
+
+            uint8_t bytes[16];
+            if(host.starts_with('[') && host.ends_with(']'))
+            {
+                host = host.substr(1, host.size() - 2);
+                if(!detail::parse_ipv6(host, bytes))
+                    return error();
+            }
+            else if(std::ranges::all_of(host, [](char c) {
+                        return c == '.' || (c >= '0' && c <= '9');
+                    }))
+            {
+                if(!detail::parse_ipv4(host, bytes))
+                    return error();
+            }
+            else if(!detail::valid_host_name(host))
+                return error();
+
+            uint16_t x;
+            auto [ptr, ec] =
+                std::from_chars(port.data(), port.data() + port.size(), x);
+            if(ec != std::errc() || ptr != port.data() + port.size())
+                return std::unexpected{
+                    std::format("invalid port {} in {}", port, s)};
+
+            *target = {.host = host, .port = x};
+            return {};
+        }
+    };
+
+    // Types flag accepts as targets, including those with a parser_traits
+    // specialization.
+    template <typename T>
+    concept builtin_parseable =
+        detail::single_parseable<T> || detail::parseable_container<T> ||
+        detail::parseable_map<T> || detail::user_parseable<T>;
+
+    // Stores the value of a flag during parse and only converts it on the
+    // first get(), which caches the result.
+    // The parsed arguments must outlive the lazy.
+    template <typename T>
+        requires detail::element_parseable<T>
+    class lazy
+    {
+      public:
+        lazy() = default;
+        lazy(T value) : value{std::move(value)} {}
+
+        // Returns the value, or the error converting it.
+        // Without the flag, it is the value lazy was constructed with.
+        const expected<T>& get() const
+        {
+            if(pending)
+            {
+                T x{};
+                auto result = detail::builtin_parse(raw, &x);
+                if(result)
+                    value = std::move(x);
+                else
+                    value = std::unexpected{std::move(result.error())};
+                pending = false;
+            }
+            return value;
+        }
+
+        // The argument the value is converted from, if the flag was parsed.
+        std::string_view source() const { return raw; }
+
+      private:
+        friend struct parser_traits<lazy>;
+
+        mutable expected<T> value{};
+        std::string_view raw;
+        mutable bool pending = false;
+    };
+
+    template <typename T>
+    struct parser_traits<lazy<T>>
+    {
+        static constexpr auto kind = detail::flag_kind_t::single;
+
+        static expected<void> parse(std::string_view s, lazy<T>* target)
+        {
+            target->raw = s;
+            target->pending = true;
+            return {};
+        }
+
+        static expected<void> validate(lazy<T>* target)
+        {
+            auto& result = target->get();
+            if(!result)
+                return std::unexpected{result.error()};
+            return {};
+        }
+    };
+
+    namespace detail
+    {
+        inline constexpr uint64_t mix64(uint64_t x)
+        {
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111eb;
+            return x ^ x >> 31;
+        }
+
+        inline uint64_t hash_bytes(const void* data, size_t n)
+        {
+            auto p = static_cast<const unsigned char*>(data);
+            uint64_t h = mix64(n + 0x9e3779b97f4a7c15);
+            if(n == 0)
+                return h;
+            for(; n >= 8; p += 8, n -= 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, p, 8);
+                h = mix64(h ^ word);
+            }
+            uint64_t tail = 0;
+            std::memcpy(&tail, p, n);
+            return mix64(h ^ tail);
+        }
+
+        // Hashes the value of a target, so that equal values hash equally
+        // however they were spelled. Elements of containers are hashed in
+        // order, those of maps in any order. Types not listed hash to 0.
+        template <typename T>
+        uint64_t hash_value(const T& x)
+        {
+            if constexpr(std::is_integral_v<T> || std::is_enum_v<T>)
+                return hash_bytes(&x, sizeof(x));
+            else if constexpr(std::is_floating_point_v<T>)
+            {
+                // long double has padding bytes
+                auto hi = static_cast<double>(x);
+                auto lo = static_cast<double>(x - hi);
+                return mix64(hash_bytes(&hi, sizeof(hi)) +
+                             hash_bytes(&lo, sizeof(lo)));
+            }
+            else if constexpr(std::is_convertible_v<const T&, std::string_view>)
+            {
+                std::string_view sv = x;
+                return hash_bytes(sv.data(), sv.size());
+            }
+            else if constexpr(std::is_same_v<T, byte_size>)
+                return hash_value(x.bytes);
+            else if constexpr(std::is_same_v<T, ipv4_address> ||
+                              std::is_same_v<T, ipv6_address>)
+                return hash_bytes(x.bytes.data(), x.bytes.size());
+            else if constexpr(std::is_same_v<T, endpoint>)
+                return mix64(hash_value(x.host) + x.port);
+            else if constexpr(requires { x.source(); })
+            {
+                // values that don't convert differ by their source
+                auto& value = x.get();
+                return value ? hash_value(*value)
+                             : mix64(hash_value(x.source()));
+            }
+            else if constexpr(requires { x.count(); } && !parseable_map<T>)
+                return hash_value(x.count());
+            else if constexpr(parseable_map<T>)
+            {
+                uint64_t h = std::ranges::size(x);
+                for(auto& [k, v] : x)
+                    h += mix64(hash_value(k) * 0x9e3779b97f4a7c15 +
+                               hash_value(v));
+                return mix64(h);
+            }
+            else if constexpr(std::ranges::input_range<const T>)
+            {
+                using value_type = std::ranges::range_value_t<T>;
+                uint64_t h = 0;
+                for(auto&& e : x)
+                    h = mix64(h + hash_value(static_cast<const value_type&>(e)));
+                return h;
+            }
+            else
+                return 0;
+        }
+
+        template <typename Period>
+        constexpr std::string_view duration_suffix()
+        {
+            using std::ratio_equal_v;
+            if constexpr(ratio_equal_v<Period, std::nano>)
+                return "ns";
+            else if constexpr(ratio_equal_v<Period, std::micro>)
+                return "us";
+            else if constexpr(ratio_equal_v<Period, std::milli>)
+                return "ms";
+            else if constexpr(ratio_equal_v<Period, std::ratio<1>>)
+                return "s";
+            else if constexpr(ratio_equal_v<Period, std::ratio<60>>)
+                return "min";
+            else if constexpr(ratio_equal_v<Period, std::ratio<3600>>)
+                return "h";
+            else
+                return "";
+        }
+
+        // Writes the value of a target.
+        // In JSON, containers are arrays, maps are objects and values
+        // that aren't numbers or booleans are strings. Elements of
+        // containers and maps are separated by ',' otherwise.
+        // Types not listed, and lazy values that don't convert, are written
+        // as null in JSON and nothing otherwise.
+        template <typename T>
+        void dump_value(dump_writer_t& out, const T& x)
+        {
+            // Writes a value that is a string in JSON.
+            auto quoted = [&](auto write) {
+                if(out.json)
+                    out.put('"');
+                write();
+                if(out.json)
+                    out.put('"');
+            };
+
+            if constexpr(std::is_same_v<T, bool>)
+                out.put(x ? "true"sv : "false"sv);
+            else if constexpr(std::is_integral_v<T>)
+                out.number(x);
+            else if constexpr(std::is_floating_point_v<T>)
+            {
+                if(std::isfinite(x))
+                    out.number(x);
+                else
+                    quoted([&] { out.number(x); });
+            }
+            else if constexpr(std::is_convertible_v<const T&, std::string_view>)
+                out.string(x);
+            else if constexpr(named_enum<T>)
+            {
+                quoted([&] {
+                    auto value = std::to_underlying(x);
+                    bool first = true;
+                    for(auto& [name, e] : enum_traits<T>::names)
+                    {
+                        auto bits = std::to_underlying(e);
+                        bool matches = bits == value;
+                        if constexpr(requires {
+                                         requires enum_traits<T>::flags;
+                                     })
+                            matches |= bits != 0 && (value & bits) == bits;
+                        if(!matches)
+                            continue;
+                        if(!first)
+                            out.put('|');
+                        out.put(name);
+                        first = false;
+                        if(bits == value)
+                            break;
+                    }
+                    if(first)
+                        out.number(value);
+                });
+            }
+            else if constexpr(std::is_same_v<T, byte_size>)
+                out.number(x.bytes);
+            else if constexpr(std::is_same_v<T, ipv4_address>)
+            {
+                quoted([&] {
+                    for(size_t i = 0; i < 4; i++)
+                    {
+                        if(i > 0)
+                            out.put('.');
+                        out.number(x.bytes[i]);
+                    }
+                });
+            }
+            else if constexpr(std::is_same_v<T, ipv6_address>)
+            {
+                quoted([&] {
+                    for(size_t i = 0; i < 16; i += 2)
+                    {
+                        char buf[8];
+                        auto end = std::to_chars(buf, std::end(buf),
+                                                 x.bytes[i] << 8 | x.bytes[i + 1],
+                                                 16)
+                                       .ptr;
+                        if(i > 0)
+                            out.put(':');
+                        out.put({buf, end});
+                    }
+                });
+            }
+            else if constexpr(std::is_same_v<T, endpoint>)
+            {
+                bool bracket = x.host.find(':') != x.host.npos;
+                quoted([&] {
+                    if(bracket)
+                        out.put('[');
+                    out.put(x.host);
+                    if(bracket)
+                        out.put(']');
+                    out.put(':');
+                    out.number(x.port);
+                });
+            }
+            else if constexpr(requires { x.source(); })
+            {
+                auto& value = x.get();
+                if(value)
+                    dump_value(out, *value);
+                else if(out.json)
+                    out.put("null"sv);
+            }
+            else if constexpr(requires { x.count(); } && !parseable_map<T>)
+            {
+                constexpr auto suffix = duration_suffix<typename T::period>();
+                if(suffix.empty())
+                    out.number(x.count());
+                else
+                    quoted([&] {
+                        out.number(x.count());
+                        out.put(suffix);
+                    });
+            }
+            else if constexpr(parseable_map<T>)
+            {
+                out.put(out.json ? "{"sv : ""sv);
+                bool first = true;
+                for(auto& [k, v] : x)
+                {
+                    if(!first)
+                        out.put(',');
+                    first = false;
+                    if constexpr(std::is_convertible_v<decltype(k),
+                                                       std::string_view>)
+                        out.string(k);
+                    else
+                        quoted([&] { dump_value(out, k); });
+                    out.put(out.json ? ':' : '=');
+                    dump_value(out, v);
+                }
+                out.put(out.json ? "}"sv : ""sv);
+            }
+            else if constexpr(std::ranges::input_range<const T>)
+            {
+                using value_type = std::ranges::range_value_t<T>;
+                out.put(out.json ? "["sv : ""sv);
+                bool first = true;
+                for(auto&& e : x)
+                {
+                    if(!first)
+                        out.put(',');
+                    first = false;
+                    dump_value(out, static_cast<const value_type&>(e));
+                }
+                out.put(out.json ? "]"sv : ""sv);
+            }
+            else if(out.json)
+                out.put("null"sv);
+        }
+    } // namespace detail
+
+    struct parse_arg_t
+    {
+        using flag_kind_t = detail::flag_kind_t;
+        static constexpr auto single = flag_kind_t::single;
+        static constexpr auto boolean = flag_kind_t::boolean;
+        static constexpr auto variable = flag_kind_t::variable;
+
+        auto operator()(std::string_view token)
+        {
+            if(delimiter)
+            {
+                auto handle = std::get_if<detail::parse_handle_t>(&target);
+                if(handle && handle->ops && handle->ops->split)
+                    return handle->ops->split(token, delimiter, handle->target);
+            }
+            return std::visit(detail::parse_visitor_t{token}, target);
+        }
+
+        // Same as operator(), except that a std::string target or element
+        // takes the buffer of source, which token is the end of.
+        expected<bool> consume(std::string_view token, std::string& source)
+        {
+            auto str = std::get_if<std::string*>(&target);
+            auto handle = std::get_if<detail::parse_handle_t>(&target);
+            if(delimiter ||
+               !(str || (handle && handle->ops && handle->ops->consume)))
+                return (*this)(token);
+
+            source.erase(0, token.data() - source.data());
+            if(str)
+            {
+                **str = std::move(source);
+                return false;
+            }
+            return handle->ops->consume(source, handle->target);
+        }
+
+        using parseable_t =
+            std::variant<bool*, char*, unsigned char*, signed char*, short*,
+                         unsigned short*, int*, unsigned int*, long*,
+                         unsigned long*, long long*, unsigned long long*,
+                         float*, double*, long double*, std::string*,
+                         std::string_view*, detail::parse_handle_t>;
+
+        flag_kind_t kind() const
+        {
+            switch(target.index())
+            {
+            case 0: return boolean;
+            case std::variant_size_v<parseable_t> - 1:
+            {
+                auto& handle = std::get<detail::parse_handle_t>(target);
+                return handle.ops ? handle.ops->kind : variable;
+            }
+            default: return single;
+            }
+        }
+
+        // Converts a target whose conversion was deferred, e.g. a lazy.
+        expected<void> validate()
+        {
+            auto handle = std::get_if<detail::parse_handle_t>(&target);
+            if(handle && handle->ops && handle->ops->validate)
+                return handle->ops->validate(handle->target);
+            return {};
+        }
+
+        // Hints that n more values are about to be parsed, so that
+        // containers can reserve for them up front.
+        void reserve(size_t n)
+        {
+            auto handle = std::get_if<detail::parse_handle_t>(&target);
+            if(handle && handle->ops && handle->ops->reserve)
+                handle->ops->reserve(handle->target, n);
+        }
+
+        // Same as reserve(values.size()), also reserving for the chars of
+        // values if the target stores them, e.g. a string_list.
+        void reserve(std::span<const std::string_view> values)
+        {
+            reserve(values.size());
+            auto handle = std::get_if<detail::parse_handle_t>(&target);
+            if(handle && handle->ops && handle->ops->reserve_chars)
+            {
+                size_t n = 0;
+                for(auto value : values)
+                    n += value.size();
+                handle->ops->reserve_chars(handle->target, n);
+            }
+        }
+
+        // The bytes of the target if it can be reset by copying them back,
+        // empty otherwise.
+        std::span<std::byte> trivial_bytes() const
+        {
+            if(auto handle = std::get_if<detail::parse_handle_t>(&target))
+            {
+                if(!handle->ops)
+                    return {};
+                return {static_cast<std::byte*>(handle->target),
+                        handle->ops->trivial_size};
+            }
+            return std::visit(
+                []<typename T>(T target) -> std::span<std::byte> {
+                    if constexpr(std::is_pointer_v<T> &&
+                                 std::is_trivially_copyable_v<
+                                     std::remove_pointer_t<T>>)
+                        return std::as_writable_bytes(std::span{target, 1});
+                    else
+                        return {};
+                },
+                target);
+        }
+
+        // Copies the value of a target that isn't trivially copyable, nullptr
+        // if it can't be.
+        std::shared_ptr<const void> snapshot() const
+        {
+            if(auto str = std::get_if<std::string*>(&target))
+                return detail::snapshot_of<std::string>(*str);
+            auto handle = std::get_if<detail::parse_handle_t>(&target);
+            if(handle && handle->ops && handle->ops->snapshot)
+                return handle->ops->snapshot(handle->target);
+            return nullptr;
+        }
+
+        const void* address() const
+        {
+            if(auto handle = std::get_if<detail::parse_handle_t>(&target))
+                return handle->target;
+            return std::visit(
+                []<typename T>(T target) -> const void* {
+                    if constexpr(std::is_pointer_v<T>)
+                        return target;
+                    else
+                        return nullptr;
+                },
+                target);
+        }
+
+        // Hashes the value of the target.
+        uint64_t hash() const
+        {
+            if(auto handle = std::get_if<detail::parse_handle_t>(&target))
+                return handle->ops && handle->ops->hash
+                           ? handle->ops->hash(handle->target)
+                           : 0;
+            return std::visit(
+                []<typename T>(T target) -> uint64_t {
+                    if constexpr(std::is_pointer_v<T>)
+                        return detail::hash_value(*target);
+                    else
+                        return 0;
+                },
+                target);
+        }
+
+        // Writes the value of the target.
+        void dump(detail::dump_writer_t& out) const
+        {
+            if(auto handle = std::get_if<detail::parse_handle_t>(&target))
+            {
+                if(handle->ops && handle->ops->dump)
+                    handle->ops->dump(handle->target, out);
+                else if(out.json)
+                    out.put("null"sv);
+                return;
+            }
+            std::visit(
+                [&]<typename T>(T target) {
+                    if constexpr(std::is_pointer_v<T>)
+                        detail::dump_value(out, *target);
+                },
+                target);
+        }
+
+        // Moves the target by offset bytes if its address is within
+        // [first, first + size), returns whether it is.
+        bool rebase(uintptr_t first, size_t size, ptrdiff_t offset)
+        {
+            auto move = [&]<typename T>(T*& target) {
+                auto address = reinterpret_cast<uintptr_t>(target);
+                if(address - first >= size)
+                    return false;
+                target = reinterpret_cast<T*>(address + offset);
+                return true;
+            };
+            if(auto handle = std::get_if<detail::parse_handle_t>(&target))
+                return move(handle->target);
+            return std::visit(
+                [&]<typename T>(T& target) {
+                    if constexpr(std::is_pointer_v<T>)
+                        return move(target);
+                    else
+                        return false;
+                },
+                target);
+        }
+
+        // Assigns a value returned by snapshot to the target.
+        void restore(const void* snapshot)
+        {
+            if(auto str = std::get_if<std::string*>(&target))
+                return detail::restore_from<std::string>(*str, snapshot);
+            auto& handle = std::get<detail::parse_handle_t>(target);
+            handle.ops->restore(handle.target, snapshot);
+        }
+
+        // Values the target accepts, if it only accepts a fixed set of them.
+        std::span<const std::string_view> choices() const
+        {
+            static constexpr std::string_view bools[] = {"false", "true"};
+            if(target.index() == 0)
+                return bools;
+            auto handle = std::get_if<detail::parse_handle_t>(&target);
+            if(handle && handle->ops)
+                return handle->ops->choices;
+            return {};
+        }
+
+        parseable_t target;
+        // If not '\0', each value of a container target is split at every
+        // delimiter into several elements.
+        char delimiter = '\0';
+    };
+
+    // Value constraints, passed to make_parse_arg as template arguments and
+    // checked as soon as values are converted, e.g.
+    //  make_parse_arg<cozy::in_range{1, 65535}>(ports)
+    // A captureless lambda taking a value and returning bool is also a
+    // constraint.
+    template <typename T>
+    struct in_range
+    {
+        T min, max;
+    };
+
+    template <typename T, size_t N>
+    struct one_of
+    {
+        T values[N];
+    };
+
+    template <typename T, typename... Ts>
+    one_of(T, Ts...) -> one_of<T, 1 + sizeof...(Ts)>;
+
+    namespace detail
+    {
+        // Returns the index of the first of xs not satisfying the constraint,
+        // or xs.size() if there is none.
+        template <typename T, typename U>
+        size_t find_violation(std::span<const T> xs, in_range<U> c)
+        {
+            // Blocks are checked without branching so that they vectorize,
+            // the violation is only searched for in the failing block.
+            auto lo = T(c.min), hi = T(c.max);
+            size_t i = 0;
+            for(; i + 16 <= xs.size(); i += 16)
+            {
+                bool bad = false;
+                for(size_t j = i; j < i + 16; j++)
+                    bad |= (xs[j] < lo) | (hi < xs[j]);
+                if(bad)
+                    break;
+            }
+            for(; i < xs.size(); i++)
+                if(xs[i] < lo || hi < xs[i])
+                    return i;
+            return i;
+        }
+
+        template <typename T, typename U, size_t N>
+        size_t find_violation(std::span<const T> xs, const one_of<U, N>& c)
+        {
+            auto it = std::ranges::find_if(xs, [&c](const T& x) {
+                return std::ranges::find(c.values, x) == std::end(c.values);
+            });
+            return it - xs.begin();
+        }
+
+        template <typename T, std::predicate<const T&> F>
+        size_t find_violation(std::span<const T> xs, F f)
+        {
+            return std::ranges::find_if_not(xs, f) - xs.begin();
+        }
+
+        template <typename U>
+        std::string describe(in_range<U> c)
+        {
+            return std::format("is not in [{}, {}]", c.min, c.max);
+        }
+
+        template <typename U, size_t N>
+        std::string describe(const one_of<U, N>& c)
+        {
+            std::string s = "is not one of";
+            for(auto& x : c.values)
+                s += std::format(" {}", x);
+            return s;
+        }
+
+        inline std::string describe(auto) { return "is rejected by constraint"; }
+
+        // Checks xs against Cs. position is where xs starts in the target
+        // container, or npos if the target isn't a container.
+        template <auto... Cs, typename T>
+        expected<void> check_values(std::span<const T> xs, size_t position)
+        {
+            size_t first = xs.size();
+            std::string reason;
+            auto check = [&](const auto& c) {
+                auto i = find_violation(xs, c);
+                if(i < first)
+                {
+                    first = i;
+                    reason = describe(c);
+                }
+            };
+            (check(Cs), ...);
+
+            if(first == xs.size())
+                return {};
+
+            std::string value = "value";
+            if constexpr(std::is_arithmetic_v<T>)
+                value = std::format("{}", xs[first]);
+            if(position != std::string_view::npos)
+                value += std::format(" at position {}", position + first);
+            return std::unexpected{std::format("{} {}", value, reason)};
+        }
+
+        // Checks the elements of target from position onwards against Cs.
+        template <auto... Cs, typename T>
+        expected<void> check_appended(const T& target, size_t position)
+        {
+            using value_type = typename T::value_type;
+            if constexpr(std::ranges::contiguous_range<T>)
+                return check_values<Cs...>(
+                    std::span<const value_type>{
+                        std::ranges::data(target) + position,
+                        std::ranges::size(target) - position},
+                    position);
+            else
+            {
+                auto it = std::next(std::ranges::begin(target), position);
+                for(; it != std::ranges::end(target); ++it, ++position)
+                {
+                    // the iterator may return values, e.g. of a string_list
+                    const value_type value = *it;
+                    auto result = check_values<Cs...>(
+                        std::span<const value_type>{&value, 1}, position);
+                    if(!result)
+                        return result;
+                }
+                return {};
+            }
+        }
+
+        template <typename T, auto... Cs>
+        expected<bool> handle_call(std::string_view token, void* target)
+        {
+            auto t = static_cast<T*>(target);
+            if constexpr(parseable_map<T>)
+            {
+                static_assert(sizeof...(Cs) == 0,
+                              "constraints are not supported for maps");
+                return builtin_parse_map(token, t);
+            }
+            else if constexpr(parseable_container<T>)
+            {
+                auto size = t->size();
+                auto result = builtin_parse_container(token, t);
+                if constexpr(sizeof...(Cs) > 0)
+                {
+                    if(result && t->size() != size)
+                    {
+                        auto checked = check_appended<Cs...>(*t, size);
+                        if(!checked)
+                            return std::unexpected{std::move(checked.error())};
+                    }
+                }
+                return result;
+            }
+            else
+            {
+                auto result = builtin_parse(token, t);
+                if constexpr(sizeof...(Cs) > 0)
+                {
+                    if(result)
+                    {
+                        auto checked = check_values<Cs...>(
+                            std::span<const T>{t, 1}, std::string_view::npos);
+                        if(!checked)
+                            return std::unexpected{std::move(checked.error())};
+                    }
+                }
+                return result;
+            }
+        }
+
+        // Appends source as an element of a container of std::string.
+        template <typename T, auto... Cs>
+        expected<bool> handle_consume(std::string& source, void* target)
+        {
+            auto t = static_cast<T*>(target);
+            auto size = t->size();
+            if constexpr(fixed_capacity_container<T>)
+            {
+                if(size == t->capacity())
+                    return std::unexpected{
+                        std::format("cannot take {}, at most {} values allowed",
+                                    source, t->capacity())};
+                t->try_push_back(std::move(source));
+            }
+            else
+                t->push_back(std::move(source));
+
+            if constexpr(sizeof...(Cs) > 0)
+            {
+                auto checked = check_appended<Cs...>(*t, size);
+                if(!checked)
+                    return std::unexpected{std::move(checked.error())};
+            }
+            return true;
+        }
+
+        template <typename T, auto... Cs>
+        expected<bool> handle_split(std::string_view token, char delimiter,
+                                    void* target)
+        {
+            auto t = static_cast<T*>(target);
+            auto size = t->size();
+            auto result = builtin_parse_split(token, delimiter, t);
+            if constexpr(sizeof...(Cs) > 0)
+            {
+                // checked as a whole, right after the run is converted
+                if(result && t->size() != size)
+                {
+                    auto checked = check_appended<Cs...>(*t, size);
+                    if(!checked)
+                        return std::unexpected{std::move(checked.error())};
+                }
+            }
+            return result;
+        }
+
+        template <typename T, auto... Cs>
+        inline constexpr handle_ops_t handle_ops = [] {
+            handle_ops_t ops;
+            ops.hash = [](const void* target) {
+                return hash_value(*static_cast<const T*>(target));
+            };
+            ops.dump = [](const void* target, dump_writer_t& out) {
+                dump_value(out, *static_cast<const T*>(target));
+            };
+            if constexpr(std::is_trivially_copyable_v<T> &&
+                         !parseable_map<T> && !parseable_container<T>)
+                ops.trivial_size = sizeof(T);
+            else if constexpr(std::is_copy_assignable_v<T>)
+            {
+                ops.snapshot = snapshot_of<T>;
+                ops.restore = restore_from<T>;
+            }
+
+            if constexpr(parseable_map<T> || parseable_container<T>)
+            {
+                ops.kind = flag_kind_t::variable;
+                ops.reserve = [](void* target, size_t n) {
+                    reserve_more(static_cast<T*>(target), n);
+                };
+                if constexpr(requires(T x) { x.reserve_chars(0); })
+                    ops.reserve_chars = [](void* target, size_t n) {
+                        reserve_more_chars(static_cast<T*>(target), n);
+                    };
+                if constexpr(parseable_container<T>)
+                    ops.split = handle_split<T, Cs...>;
+                if constexpr(parseable_container<T> &&
+                             std::is_same_v<typename T::value_type,
+                                            std::string>)
+                    ops.consume = handle_consume<T, Cs...>;
+            }
+            else if constexpr(user_parseable<T>)
+            {
+                ops.kind = parser_traits<T>::kind;
+                if constexpr(requires { parser_traits<T>::choices; })
+                    ops.choices = parser_traits<T>::choices;
+                if constexpr(requires(T x) { parser_traits<T>::validate(&x); })
+                    ops.validate = [](void* target) {
+                        return parser_traits<T>::validate(
+                            static_cast<T*>(target));
+                    };
+            }
+            else
+                ops.kind = std::is_same_v<T, bool> ? flag_kind_t::boolean
+                                                   : flag_kind_t::single;
+            return ops;
+        }();
+
+        // Containers, maps and types with parser_traits are parsed through
+        // a handle, the conversion is a direct call within handle_call so it
+        // inlines into the handle.
+        template <typename T, auto... Cs>
+        parse_handle_t make_handle(T& target)
+        {
+            return {.target = &target,
+                    .call = handle_call<T, Cs...>,
+                    .ops = &handle_ops<T, Cs...>};
+        }
+    } // namespace detail
+
+    template <detail::single_parseable T>
+    inline parse_arg_t make_parse_arg(T& target)
+    {
+        return parse_arg_t{.target = &target};
+    }
+
+    // Containers take every value up to the next flag, maps take key=value
+    // pairs split at the first '='.
+    template <builtin_parseable T>
+        requires(!detail::single_parseable<T>)
+    inline parse_arg_t make_parse_arg(T& target)
+    {
+        return {.target = detail::make_handle(target)};
+    }
+
+    // Checks every value of target against Constraints as soon as it is
+    // converted. For containers, the error names the position of the first
+    // element violating them.
+    template <auto... Constraints, builtin_parseable T>
+        requires(sizeof...(Constraints) > 0)
+    inline parse_arg_t make_parse_arg(T& target)
+    {
+        return {.target = detail::make_handle<T, Constraints...>(target)};
+    }
+
+    // Values of target are split at every delimiter, i.e. -v=1,2,3 parses
+    // three elements.
+    template <auto... Constraints, detail::parseable_container T>
+    inline parse_arg_t make_parse_arg(T& target, char delimiter)
+    {
+        auto parse_arg = make_parse_arg<Constraints...>(target);
+        parse_arg.delimiter = delimiter;
+        return parse_arg;
+    }
+
+    namespace detail
+    {
+        // Returns the first char of [first, last) that is one of Cs, or last.
+        // Eight chars are compared at a time.
+        template <char... Cs>
+        inline const char* find_any(const char* first, const char* last)
+        {
+            for(; last - first >= 8; first += 8)
+            {
+                uint64_t x;
+                std::memcpy(&x, first, 8);
+                if constexpr(std::endian::native == std::endian::big)
+                    x = std::byteswap(x);
+                auto found = (swar_in_range(x, uint8_t(Cs), 1) | ...);
+                if(found)
+                    return first + std::countr_zero(found) / 8;
+            }
+            for(; first != last; ++first)
+                if(((*first == Cs) || ...))
+                    return first;
+            return last;
+        }
+
+        inline bool is_blank(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n';
+        }
+    } // namespace detail
+
+    // Arguments split from a single command line, quoted the way a POSIX
+    // shell does without any expansion: a backslash escapes the next char,
+    // '...' is literal and "..." only escapes $ ` " \ and newlines.
+    // Arguments that need no unescaping, including a whole quoted argument,
+    // view the line, the others view one buffer owned by command_line.
+    // Reusing a command_line keeps the capacity of its buffers, e.g.
+    //  cozy::command_line line;
+    //  line.split(job_spec);
+    //  parser.parse(line.args());
+    class command_line
+    {
+      public:
+        // Splits line, replacing the previous arguments.
+        // line must outlive the arguments.
+        expected<void> split(std::string_view line);
+
+        std::span<const std::string_view> args() const { return views; }
+
+      private:
+        std::vector<std::string_view> views;
+        std::unique_ptr<char[]> arena;
+        size_t arena_size = 0;
+    };
+
+    inline expected<void> command_line::split(std::string_view line)
+    {
+        views.clear();
+        // unescaping never lengthens an argument
+        if(arena_size < line.size())
+        {
+            arena = std::make_unique_for_overwrite<char[]>(line.size());
+            arena_size = line.size();
+        }
+
+        auto p = line.data(), end = line.data() + line.size();
+        auto out = arena.get();
+        auto unterminated = [](char quote) {
+            return std::unexpected{
+                std::format("unterminated {} in command line", quote)};
+        };
+        auto copy = [&](const char* first, const char* last) {
+            std::memcpy(out, first, last - first);
+            out += last - first;
+        };
+
+        while(true)
+        {
+            // A line continuation between words is a blank, not an empty
+            // word.
+            while(p != end && (detail::is_blank(*p) ||
+                               (*p == '\\' && p + 1 != end && p[1] == '\n')))
+                p += *p == '\\' ? 2 : 1;
+            if(p == end)
+                return {};
+
+            auto word = p;
+            auto copied = out;
+            bool copying = false;
+            while(true)
+            {
+                auto q = detail::find_any<' ', '\t', '\n', '\'', '"', '\\'>(
+                    p, end);
+                if(q == end || detail::is_blank(*q))
+                {
+                    if(!copying)
+                        views.emplace_back(word, q);
+                    else
+                    {
+                        copy(p, q);
+                        views.emplace_back(copied, out);
+                    }
+                    p = q;
+                    break;
+                }
+
+                if(*q == '\\')
+                {
+                    if(q + 1 == end)
+                        return std::unexpected{"trailing \\ in command line"s};
+                    if(!copying)
+                        copy(word, q);
+                    else
+                        copy(p, q);
+                    copying = true;
+                    if(q[1] != '\n')
+                        *out++ = q[1];
+                    p = q + 2;
+                    continue;
+                }
+
+                // Find the closing quote, noting escapes in double quotes.
+                auto quote = *q;
+                auto close = quote == '\''
+                                 ? detail::find_any<'\''>(q + 1, end)
+                                 : detail::find_any<'"', '\\'>(q + 1, end);
+                if(close == end)
+                    return unterminated(quote);
+
+                // A whole quoted argument without escapes is viewed as is.
+                if(!copying && q == word && *close == quote &&
+                   (close + 1 == end || detail::is_blank(close[1])))
+                {
+                    views.emplace_back(q + 1, close);
+                    p = close + 1;
+                    break;
+                }
+
+                if(!copying)
+                    copy(word, q);
+                else
+                    copy(p, q);
+                copying = true;
+
+                auto first = q + 1;
+                while(*close != quote)
+                {
+                    // close is a backslash within double quotes
+                    if(close + 1 == end)
+                        return unterminated(quote);
+                    copy(first, close);
+                    auto c = close[1];
+                    if(c != '\n')
+                    {
+                        if(c != '$' && c != '`' && c != '"' && c != '\\')
+                            *out++ = '\\';
+                        *out++ = c;
+                    }
+                    first = close + 2;
+                    close = detail::find_any<'"', '\\'>(first, end);
+                    if(close == end)
+                        return unterminated(quote);
+                }
+                copy(first, close);
+                p = close + 1;
+            }
+        }
     }
 
-    template <detail::parseable_container T>
-    inline parse_arg_t make_parse_arg(T& target)
-    {
-        auto call = [](std::string_view token, void* target) {
-            return detail::builtin_parse_container(token,
-                                                   static_cast<T*>(target));
+    // Arguments packed one after another, each terminated by '\0', e.g. the
+    // content of /proc/self/cmdline. Iterating views each argument in place.
+    // The '\0' of the last argument may be missing.
+    class packed_args : public std::ranges::view_interface<packed_args>
+    {
+      public:
+        class iterator
+        {
+          public:
+            using iterator_concept = std::forward_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = ptrdiff_t;
+
+            iterator() = default;
+            iterator(const char* first, const char* last)
+                : first{first}, last{last}
+            {
+                find_end();
+            }
+
+            std::string_view operator*() const { return {first, end}; }
+
+            iterator& operator++()
+            {
+                first = end == last ? last : end + 1;
+                find_end();
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                auto it = *this;
+                ++*this;
+                return it;
+            }
+
+            bool operator==(const iterator& other) const
+            {
+                return first == other.first;
+            }
+
+            bool operator==(std::default_sentinel_t) const
+            {
+                return first == last;
+            }
+
+          private:
+            void find_end()
+            {
+                auto nul = first == last
+                               ? nullptr
+                               : static_cast<const char*>(
+                                     std::memchr(first, '\0', last - first));
+                end = nul ? nul : last;
+            }
+
+            const char* first = nullptr;
+            const char* last = nullptr;
+            const char* end = nullptr;
+        };
+
+        packed_args() = default;
+        explicit packed_args(std::string_view buffer) : buffer{buffer} {}
+
+        iterator begin() const
+        {
+            return {buffer.data(), buffer.data() + buffer.size()};
+        }
+
+        std::default_sentinel_t end() const { return {}; }
+
+        // The arguments after the first, which is the program name in
+        // /proc/self/cmdline.
+        packed_args rest() const
+        {
+            auto nul = buffer.find('\0');
+            return packed_args{nul == buffer.npos ? std::string_view{}
+                                                  : buffer.substr(nul + 1)};
+        }
+
+      private:
+        std::string_view buffer;
+    };
+
+    namespace detail
+    {
+        // Chunks of chars that strings are copied into. Chunks never move,
+        // so views of the copies stay valid for the lifetime of the arena.
+        // Copies of an arena share its chunks and copy new strings into
+        // chunks of their own.
+        class string_arena_t
+        {
+          public:
+            string_arena_t() = default;
+            string_arena_t(const string_arena_t& other) : chunks{other.chunks}
+            {
+            }
+            string_arena_t(string_arena_t&& other) noexcept
+                : chunks{std::move(other.chunks)},
+                  first{std::exchange(other.first, nullptr)},
+                  last{std::exchange(other.last, nullptr)}
+            {
+            }
+            string_arena_t& operator=(string_arena_t other) noexcept
+            {
+                std::swap(chunks, other.chunks);
+                std::swap(first, other.first);
+                std::swap(last, other.last);
+                return *this;
+            }
+
+            std::string_view copy(std::string_view s)
+            {
+                if(s.empty())
+                    return {};
+                reserve(s.size());
+                auto ret = first;
+                std::memcpy(first, s.data(), s.size());
+                first += s.size();
+                return {ret, s.size()};
+            }
+
+            // Copies the concatenation of pieces.
+            std::string_view copy(std::initializer_list<std::string_view> pieces)
+            {
+                size_t n = 0;
+                for(auto piece : pieces)
+                    n += piece.size();
+                if(n == 0)
+                    return {};
+                reserve(n);
+                auto ret = first;
+                for(auto piece : pieces)
+                {
+                    std::memcpy(first, piece.data(), piece.size());
+                    first += piece.size();
+                }
+                return {ret, n};
+            }
+
+            // Makes room for n more chars in the current chunk.
+            void reserve(size_t n)
+            {
+                if(size_t(last - first) >= n)
+                    return;
+                auto size = std::max({n, 2 * chunk_size, size_t(4096)});
+                chunks.emplace_back(new char[size]);
+                first = chunks.back().get();
+                last = first + size;
+                chunk_size = size;
+            }
+
+          private:
+            std::vector<std::shared_ptr<char[]>> chunks;
+            char* first = nullptr;
+            char* last = nullptr;
+            size_t chunk_size = 0;
+        };
+
+        // Open addressing set of the strings copied into an arena, so that
+        // equal strings are copied once.
+        class string_pool_t
+        {
+          public:
+            std::string_view intern(std::string_view s, string_arena_t& arena)
+            {
+                if(s.empty())
+                    return {};
+                if(2 * (count + 1) > slots.size())
+                    rehash(std::max(size_t(16), 2 * slots.size()));
+                auto mask = slots.size() - 1;
+                for(auto i = hash_bytes(s.data(), s.size()) & mask;;
+                    i = (i + 1) & mask)
+                {
+                    if(!slots[i].data())
+                    {
+                        count++;
+                        return slots[i] = arena.copy(s);
+                    }
+                    if(slots[i] == s)
+                        return slots[i];
+                }
+            }
+
+            // Reserves for n more strings.
+            void reserve(size_t n)
+            {
+                if(2 * (count + n) > slots.size())
+                    rehash(std::bit_ceil(2 * (count + n)));
+            }
+
+          private:
+            void rehash(size_t size)
+            {
+                std::vector<std::string_view> old(size);
+                std::swap(old, slots);
+                auto mask = size - 1;
+                for(auto s : old)
+                {
+                    if(!s.data())
+                        continue;
+                    auto i = hash_bytes(s.data(), s.size()) & mask;
+                    while(slots[i].data())
+                        i = (i + 1) & mask;
+                    slots[i] = s;
+                }
+            }
+
+            // empty strings aren't copied, so a null data is an empty slot
+            std::vector<std::string_view> slots;
+            size_t count = 0;
         };
-        auto handle = detail::parse_handle_t{.target = &target, .call = call};
-        return {.target = handle};
-    }
+    } // namespace detail
+
+    // Scratch buffers of parse. Passing the same context to each parse keeps
+    // their capacity, so that parsing stops allocating once warmed up.
+    class parse_context_t
+    {
+      public:
+        // Releases the capacity beyond what the last parse used.
+        void shrink_to_fit()
+        {
+            tokens.shrink_to_fit();
+            kinds.shrink_to_fit();
+            remaining.shrink_to_fit();
+            sources.shrink_to_fit();
+        }
+
+        // Releases all capacity.
+        void reset() { *this = {}; }
+
+      private:
+        friend class parser_t;
+
+        std::vector<std::string_view> tokens;
+        std::vector<detail::token_kind_t> kinds;
+        std::vector<std::string_view> remaining;
+        // In parse_consuming, the argument each token is the end of.
+        std::vector<std::string*> sources;
+    };
+
+    class parser_t;
+
+    // Adds flags whose names share a dotted prefix, e.g. the flags of a
+    // subsystem bound to the members of its config struct:
+    //  void add_flags(cozy::flag_scope_t scope, pool_config& pool)
+    //  {
+    //      scope.flag("size", "connections", pool.size); // --db.pool.size
+    //  }
+    //  add_flags(parser.scope("db").scope("pool"), config.db.pool);
+    // Names and help are copied into the parser like owned_flag, so building
+    // a name costs as much as its length, regardless of how many flags there
+    // are. The parser must outlive its scopes.
+    class flag_scope_t
+    {
+      public:
+        // Returns the scope of the flags named prefix.name.
+        [[nodiscard]] flag_scope_t scope(std::string_view name) const;
+
+        // Adds the flag prefix.name, name is given without dashes.
+        void flag(std::string_view name, std::string_view help,
+                  builtin_parseable auto& target) const;
+
+        void flag(std::string_view name, std::string_view help,
+                  parse_arg_t parse_arg) const;
+
+        // The dashed prefix of the names of the flags, e.g. "--db.pool.".
+        [[nodiscard]] std::string_view prefix() const { return dotted; }
+
+      private:
+        friend class parser_t;
+
+        flag_scope_t(parser_t& parser, std::string_view dotted)
+            : parser{&parser}, dotted{dotted}
+        {
+        }
+
+        static void check_segment(std::string_view name);
+
+        parser_t* parser;
+        std::string_view dotted;
+    };
 
     class parser_t
     {
       public:
         // Parses a span of arguments.
         // Typically, you pass std::span{argv + 1, argv + argc} from main.
-        // Returns the remaining arguments that aren't part of flags.
+        // Returns the remaining arguments that aren't part of flags or taken
+        // by positionals.
         template <std::convertible_to<std::string_view> String>
         [[nodiscard]] expected<std::vector<std::string_view>>
         parse(std::span<String> args);
 
+        // Same as parse(args), using the buffers of context.
+        // The remaining arguments are stored in context until its next use.
+        template <std::convertible_to<std::string_view> String>
+        [[nodiscard]] expected<std::span<const std::string_view>>
+        parse(std::span<String> args, parse_context_t& context);
+
+        // Same as parse(args), iterating the packed arguments in place.
+        [[nodiscard]] expected<std::vector<std::string_view>>
+        parse(packed_args args);
+
+        [[nodiscard]] expected<std::span<const std::string_view>>
+        parse(packed_args args, parse_context_t& context);
+
+        // Same as parse(args), except that std::string targets and elements
+        // of containers of std::string take the buffers of the arguments
+        // they are parsed from. Those arguments are left in a valid but
+        // unspecified state, the remaining arguments are left intact.
+        [[nodiscard]] expected<std::vector<std::string_view>>
+        parse_consuming(std::span<std::string> args);
+
+        [[nodiscard]] expected<std::span<const std::string_view>>
+        parse_consuming(std::span<std::string> args, parse_context_t& context);
+
+        // Parses each of arg_lists into the corresponding element of outputs
+        // on up to threads threads, returning the results in the same order.
+        // Flags must be bound to members of prototype, every output starts
+        // as a copy of it. The parser itself isn't modified, each thread
+        // parses with its own copy and parse_context_t, and steals from the
+        // others once it runs out of arg lists.
+        template <typename Options, std::ranges::random_access_range ArgLists>
+        [[nodiscard]] std::vector<expected<std::vector<std::string_view>>>
+        parse_many(const Options& prototype, const ArgLists& arg_lists,
+                   std::span<std::type_identity_t<Options>> outputs,
+                   unsigned threads = std::thread::hardware_concurrency()) const;
+
         // Adds a flag to the parser, with constexpr name and help.
-        // target can be a basic type, std::string, std::string_view or a
-        // container of them.
+        // target can be a basic type, std::string, std::string_view, a
+        // container of them, a map between them or a type with a
+        // parser_traits specialization.
         // target must be kept alive throught the lifetime of parser_t.
         // Equivalent to vflag(name, help, make_parse_arg(target))
         void flag(flag_name_t name, help_str_t help,
                   builtin_parseable auto& target);
 
+        // Same as flag except parse_arg is constructed by the caller, e.g.
+        // flag("-v", "help", make_parse_arg(target, ',')).
+        void flag(flag_name_t name, help_str_t help, parse_arg_t parse_arg);
+
         // Same as flag except name and help can be runtime values.
         // parse_arg is constructed by calling make_parse_arg(target).
         // The string that name and help refers to must be kept alive thoughout
@@ -327,6 +3057,92 @@ namespace cozy
         void vflag(std::string_view name, std::string_view help,
                    parse_arg_t parse_arg);
 
+        // Same as vflag except name and help are copied into storage owned by
+        // the parser, so that they don't need to outlive the call.
+        // With share_help, equal help strings are only stored once.
+        void owned_flag(std::string_view name, std::string_view help,
+                        parse_arg_t parse_arg, bool share_help = true);
+
+        // Binds the next arguments that aren't part of flags to target, in the
+        // order positionals are added. A container target takes every such
+        // argument that follows, others take exactly one.
+        // The values are converted in the same pass as flags, parse fails if
+        // some of them are missing. name and help are shown in options, and
+        // name in the dump. The strings must be kept alive throughout the
+        // lifetime of parser_t.
+        void positional(std::string_view name, std::string_view help,
+                        builtin_parseable auto& target);
+
+        void positional(std::string_view name, std::string_view help,
+                        parse_arg_t parse_arg);
+
+        // Same as positional except that a container target takes exactly n
+        // values.
+        void positional(std::string_view name, std::string_view help,
+                        parse_arg_t parse_arg, size_t n);
+
+        // Reserves for n more flags added by owned_flag, whose names and
+        // help strings are chars long in total. Adding them then allocates
+        // a constant number of times.
+        void reserve_owned(size_t n, size_t chars);
+
+        // Returns the scope of the flags named --name.*, see flag_scope_t.
+        [[nodiscard]] flag_scope_t scope(std::string_view name);
+
+        // Makes parse fail unless name is given.
+        void require(std::string_view name);
+
+        // Makes parse fail if more than one of names is given.
+        void exclusive(std::initializer_list<std::string_view> names);
+
+        // Makes parse fail if name is given without all of requisites.
+        void depends(std::string_view name,
+                     std::initializer_list<std::string_view> requisites);
+
+        // Builds the lookup index and compiles the rules above into bitsets.
+        // Adding a rule throws if a name isn't a valid flag name, spelled
+        // with its dashes. The names in rules must refer to flags added by
+        // then, and the strings must be kept alive until then.
+        // parse calls freeze if flags or rules were added since the last
+        // call.
+        void freeze();
+
+        // Restores every target to its value when it was frozen, which is
+        // its default. Trivially copyable targets are copied back from one
+        // packed snapshot, in as few memcpy as their layout allows. Other
+        // targets are assigned a copy, containers keep their capacity.
+        void reset_to_defaults();
+
+        // Hash of the values of all targets after the last parse. It doesn't
+        // depend on the order or spelling of the arguments, e.g. -x=1 and
+        // -x 1, and a target shared by several flags counts once.
+        // parse only records which flags were given, their targets are
+        // rehashed here, which converts lazy targets. Targets must not be
+        // changed other than by parse and reset_to_defaults.
+        [[nodiscard]] uint64_t fingerprint();
+
+        // Whether the flag name, spelled with its dashes, was given in the
+        // last parse. False if name isn't a valid flag name.
+        [[nodiscard]] bool was_set(std::string_view name) const;
+
+        // Flags given in the last parse, where bit i of the bitset is the
+        // i-th added flag.
+        [[nodiscard]] std::span<const uint64_t> set_flags() const
+        {
+            return seen;
+        }
+
+        // Converts the values of all lazy targets now, returning the first
+        // error.
+        [[nodiscard]] expected<void> validate_all();
+
+        // Returns the completions of the last argument in args, which is the
+        // one being typed. Candidates are flags spelled with their dashes, or
+        // values of a flag whose target only accepts a fixed set of them.
+        template <std::convertible_to<std::string_view> String>
+        [[nodiscard]] std::vector<std::string>
+        complete(std::span<String> args);
+
         // Writes the options string to it.
         // The length of the string can be computed by options_len.
         template <std::output_iterator<char> It>
@@ -339,7 +3155,27 @@ namespace cozy
         // help_newlines is the number of '\n' in help strings.
         [[nodiscard]] size_t options_len(int help_newlines = 0) const;
 
+        // Writes name=value for each flag and positional to it, one per
+        // line, or a JSON object of them if json is true.
+        // The length of the dump is computed exactly by dump_len.
+        template <std::output_iterator<char> It>
+        auto dump_to(It it, bool json = false) const -> It;
+
+        // Returns the dump.
+        [[nodiscard]] std::string dump(bool json = false) const;
+
+#if __has_include(<unistd.h>)
+        // Writes the dump to fd with a single write, unless it is
+        // interrupted.
+        expected<void> dump(int fd, bool json = false) const;
+#endif
+
+        // Computes the length of the dump.
+        [[nodiscard]] size_t dump_len(bool json = false) const;
+
       private:
+        friend class flag_scope_t;
+
         struct flag_info_t
         {
             std::string_view name, help;
@@ -350,28 +3186,276 @@ namespace cozy
         // index is the original order, as opposed to the sorted order
         std::vector<flag_info_t> flag_info;
 
+        struct positional_info_t
+        {
+            std::string_view name, help;
+            parse_arg_t parse_arg;
+            // number of values taken, variadic if it takes all of them
+            size_t arity;
+        };
+        static constexpr size_t variadic = size_t(-1);
+        std::vector<positional_info_t> positionals;
+
+        // names and help of flags added by owned_flag
+        detail::string_arena_t strings;
+        detail::string_pool_t shared_help;
+
+        detail::flag_index_t index;
+        bool frozen = false;
+
+        // bitset of flags given in the last parse
+        std::vector<uint64_t> seen;
+
+        struct rule_t
+        {
+            enum kind_t
+            {
+                required,
+                exclusive,
+                depends,
+            } kind;
+            // names[0] is the dependent flag for depends, cleared once the
+            // names are compiled into flags and requisites
+            std::vector<std::string_view> names;
+            detail::flag_set_t flags = {}, requisites = {};
+        };
+        std::vector<rule_t> rules;
+        size_t compiled_rules = 0;
+        detail::flag_set_t required_flags;
+
+        // Defaults of the targets of the first snapshotted flags and
+        // positionals.
+        // Trivially copyable targets that are adjacent in memory are merged
+        // into one block, whose bytes are at offset in default_bytes.
+        struct default_block_t
+        {
+            std::byte* target;
+            size_t offset, size;
+        };
+        std::vector<default_block_t> default_blocks;
+        std::vector<std::byte> default_bytes;
+        struct default_value_t
+        {
+            // index into positionals if positional, flag_info otherwise
+            uint32_t index;
+            bool positional;
+            std::shared_ptr<const void> value;
+        };
+        std::vector<default_value_t> default_values;
+        size_t snapshotted = 0, snapshotted_positionals = 0;
+
+        // For each flag, the first flag with the same target, and the hashes
+        // of its name and value when frozen and when last rehashed. The
+        // fingerprint is the sum of the hashes of the first flags, so only
+        // given flags are rehashed.
+        struct flag_hash_t
+        {
+            uint32_t first;
+            uint64_t default_hash, hash;
+        };
+        std::vector<flag_hash_t> flag_hashes;
+        // Same for positionals, which are all rehashed if any was given.
+        std::vector<flag_hash_t> positional_hashes;
+        uint64_t default_fingerprint = 0, last_fingerprint = 0;
+        // bitset of the flags given since their targets were last rehashed
+        std::vector<uint64_t> unhashed;
+        bool positionals_unhashed = false;
+        // bitset of the first flags rehashed by the last fingerprint
+        std::vector<uint64_t> rehashed;
+
+        uint64_t flag_hash(uint32_t i) const;
+        uint64_t positional_hash(uint32_t i) const;
+
+        void snapshot_defaults();
+
+        // Moves the targets in [from, from + size) to the same offset from
+        // to. Throws if some target isn't in [from, from + size).
+        void rebase(const void* from, size_t size, const void* to);
+
+        expected<void> check_rules() const;
+        static void
+        check_rule_names(std::initializer_list<std::string_view> names);
+
+        // Returns the index into flag_info of the flag named token, or of the
+        // only long flag it is a prefix of. Returns flag_index_t::npos if
+        // there is none, and an error if the prefix is ambiguous.
+        expected<uint32_t> find_flag(std::string_view token) const;
+
         void unguarded_vflag(std::string_view name, std::string_view help,
                              parse_arg_t parse_arg);
 
+        static std::string_view undashed(std::string_view name);
+        static std::string dashed(std::string_view name);
         static size_t dashed_len(std::string_view name);
         static size_t flag_len(const flag_info_t& x);
+        size_t longest_name() const;
+
+        void dump_with(detail::dump_writer_t& out) const;
+
+        // Parses the tokens in context, which were just tokenized.
+        expected<std::span<const std::string_view>>
+        parse_tokens(parse_context_t& context);
     };
 
     template <std::convertible_to<std::string_view> String>
     expected<std::vector<std::string_view>>
     parser_t::parse(std::span<String> args)
+    {
+        parse_context_t context;
+        auto result = parse(args, context);
+        if(!result)
+            return std::unexpected{std::move(result.error())};
+        return std::move(context.remaining);
+    }
+
+    template <std::convertible_to<std::string_view> String>
+    expected<std::span<const std::string_view>>
+    parser_t::parse(std::span<String> args, parse_context_t& context)
+    {
+        detail::semantic_tokenize(args, context.tokens, context.kinds);
+        return parse_tokens(context);
+    }
+
+    inline expected<std::vector<std::string_view>>
+    parser_t::parse(packed_args args)
+    {
+        parse_context_t context;
+        auto result = parse(args, context);
+        if(!result)
+            return std::unexpected{std::move(result.error())};
+        return std::move(context.remaining);
+    }
+
+    inline expected<std::span<const std::string_view>>
+    parser_t::parse(packed_args args, parse_context_t& context)
+    {
+        detail::semantic_tokenize(args, context.tokens, context.kinds);
+        return parse_tokens(context);
+    }
+
+    inline expected<std::vector<std::string_view>>
+    parser_t::parse_consuming(std::span<std::string> args)
+    {
+        parse_context_t context;
+        auto result = parse_consuming(args, context);
+        if(!result)
+            return std::unexpected{std::move(result.error())};
+        return std::move(context.remaining);
+    }
+
+    inline expected<std::span<const std::string_view>>
+    parser_t::parse_consuming(std::span<std::string> args,
+                              parse_context_t& context)
+    {
+        auto& tokens = context.tokens;
+        auto& kinds = context.kinds;
+        detail::semantic_tokenize(args, tokens, kinds);
+
+        // Values are whole arguments or what follows '=' in them, either way
+        // they end where their argument does.
+        auto& sources = context.sources;
+        sources.assign(tokens.size(), nullptr);
+        for(size_t i = 0, arg = 0; i < tokens.size(); i++)
+        {
+            if(kinds[i] == detail::token_kind_t::flag)
+                continue;
+            auto end = tokens[i].data() + tokens[i].size();
+            while(arg < args.size() &&
+                  args[arg].data() + args[arg].size() != end)
+                arg++;
+            if(arg == args.size())
+                break;
+            sources[i] = &args[arg++];
+        }
+
+        // The pointers into args mustn't outlive this call, even if parse
+        // throws.
+        struct clear_t
+        {
+            std::vector<std::string*>& sources;
+            ~clear_t() { sources.clear(); }
+        } clear{sources};
+        return parse_tokens(context);
+    }
+
+    inline expected<std::span<const std::string_view>>
+    parser_t::parse_tokens(parse_context_t& context)
     {
         // TODO: currently err_unknown = false is not implemented correctly
         static constexpr bool err_unknown = true;
 
         using detail::token_kind_t;
-        auto [tokens, kinds] = detail::semantic_tokenize(args);
+        auto& tokens = context.tokens;
+        auto& kinds = context.kinds;
+        auto& remaining = context.remaining;
+        remaining.clear();
+
+        if(!frozen)
+            freeze();
+        std::ranges::fill(seen, 0);
 
-        std::vector<std::string_view> remaining;
         parse_arg_t* parse_arg = nullptr;
         auto tb = tokens.begin();
         auto kb = kinds.begin(), ke = kinds.end();
 
+        // the positional taking the next literal, and how many it took
+        size_t next = 0, taken = 0;
+        bool reserved = false;
+
+        auto convert = [&sources = context.sources,
+                        &tokens](parse_arg_t* parse_arg, auto tb) {
+            if(!sources.empty())
+                if(auto source = sources[tb - tokens.begin()])
+                    return parse_arg->consume(*tb, *source);
+            return (*parse_arg)(*tb);
+        };
+
+        // Ends the values of the next positional once it took all of them.
+        auto end_of_positional = [&]() -> expected<void>
+        {
+            auto& x = positionals[next];
+            if(x.parse_arg.kind() == parse_arg_t::variable)
+            {
+                auto result = x.parse_arg({});
+                if(!result)
+                    return std::unexpected{std::move(result.error())};
+            }
+            next++;
+            taken = 0;
+            reserved = false;
+            return {};
+        };
+
+        // Passes the literal at tb to the next positional, returns whether
+        // there is one.
+        auto to_positional = [&](auto tb, auto kb) -> expected<bool>
+        {
+            if(next == positionals.size())
+                return false;
+
+            auto& x = positionals[next];
+            if(x.arity > 1 && !reserved)
+            {
+                // the values are at most the run of tokens up to the next flag
+                auto run = size_t(std::find(kb, ke, token_kind_t::flag) - kb);
+                x.parse_arg.reserve(std::span<const std::string_view>{
+                    tb, std::min(run, x.arity - taken)});
+                reserved = true;
+            }
+
+            positionals_unhashed = true;
+            auto result = convert(&x.parse_arg, tb);
+            if(!result)
+                return std::unexpected{std::move(result.error())};
+            if(++taken == x.arity)
+            {
+                auto ended = end_of_positional();
+                if(!ended)
+                    return std::unexpected{std::move(ended.error())};
+            }
+            return true;
+        };
+
         auto end_of_flag = [](auto& parse_arg, auto& tb) -> expected<void>
         {
             if(parse_arg->kind() == parse_arg_t::single)
@@ -398,19 +3482,23 @@ namespace cozy
             {
             case token_kind_t::literal:
             {
-                if(!parse_arg)
+                if(!parse_arg || parse_arg->kind() == parse_arg_t::boolean)
                 {
-                    remaining.push_back(*tb);
-                }
-                else if(parse_arg->kind() == parse_arg_t::boolean)
-                {
-                    (void)(*parse_arg)({});
-                    parse_arg = nullptr;
-                    remaining.push_back(*tb);
+                    if(parse_arg)
+                    {
+                        (void)(*parse_arg)({});
+                        parse_arg = nullptr;
+                    }
+
+                    auto result = to_positional(tb, kb);
+                    if(!result)
+                        return std::unexpected{std::move(result.error())};
+                    if(!result.value())
+                        remaining.push_back(*tb);
                 }
                 else
                 {
-                    auto result = (*parse_arg)(*tb);
+                    auto result = convert(parse_arg, tb);
                     if(!result)
                         return std::unexpected{std::move(result.error())};
                     if(!result.value())
@@ -423,58 +3511,275 @@ namespace cozy
             case token_kind_t::arg:
             {
                 // precondition: parse_arg != nullptr
-                auto result = (*parse_arg)(*tb);
+                auto result = convert(parse_arg, tb);
                 if(!result)
                     return std::unexpected{std::move(result.error())};
                 if(!result.value())
                     parse_arg = nullptr;
 
-                tb++;
-                break;
-            }
-            case token_kind_t::flag:
-            {
-                if(parse_arg)
-                {
-                    auto result = end_of_flag(parse_arg, tb);
-                    if(!result)
-                        return std::unexpected{result.error()};
-                }
+                tb++;
+                break;
+            }
+            case token_kind_t::flag:
+            {
+                reserved = false;
+                if(parse_arg)
+                {
+                    auto result = end_of_flag(parse_arg, tb);
+                    if(!result)
+                        return std::unexpected{result.error()};
+                }
+
+                auto token = *tb;
+                auto found = find_flag(token);
+                if(!found)
+                    return std::unexpected{std::move(found.error())};
+                if(*found == detail::flag_index_t::npos)
+                {
+                    if(err_unknown)
+                    {
+                        auto dashes = token.size() > 1 ? "--"sv : "-"sv;
+                        return std::unexpected{
+                            std::format("unknown flag {}{}", dashes, token)};
+                    }
+
+                    remaining.push_back(token);
+                }
+                else
+                {
+                    seen[*found / 64] |= uint64_t(1) << (*found % 64);
+                    unhashed[*found / 64] |= uint64_t(1) << (*found % 64);
+                    parse_arg = &flag_info[*found].parse_arg;
+                    if(parse_arg->kind() == parse_arg_t::variable)
+                    {
+                        // the values are the run of tokens up to the next flag
+                        auto run = std::find(kb + 1, ke, token_kind_t::flag);
+                        parse_arg->reserve(std::span<const std::string_view>{
+                            tb + 1, size_t(run - kb - 1)});
+                    }
+                }
+
+                tb++;
+                break;
+            }
+            }
+        }
+
+        if(parse_arg)
+        {
+            auto result = end_of_flag(parse_arg, tb);
+            if(!result)
+                return std::unexpected{result.error()};
+        }
+
+        while(next < positionals.size())
+        {
+            auto& x = positionals[next];
+            if(x.arity == 1 && taken == 0)
+                return std::unexpected{
+                    std::format("missing positional {}", x.name)};
+            if(x.arity != variadic && taken < x.arity)
+                return std::unexpected{
+                    std::format("missing values of {}, expected {} but got {}",
+                                x.name, x.arity, taken)};
+
+            auto result = end_of_positional();
+            if(!result)
+                return std::unexpected{std::move(result.error())};
+        }
+
+        auto result = check_rules();
+        if(!result)
+            return std::unexpected{std::move(result.error())};
+
+        return std::span<const std::string_view>{remaining};
+    }
+
+    template <typename Options, std::ranges::random_access_range ArgLists>
+    std::vector<expected<std::vector<std::string_view>>>
+    parser_t::parse_many(const Options& prototype, const ArgLists& arg_lists,
+                         std::span<std::type_identity_t<Options>> outputs,
+                         unsigned threads) const
+    {
+        auto n = std::ranges::size(arg_lists);
+        if(outputs.size() < n)
+            throw std::invalid_argument{"fewer outputs than arg lists"};
+        if(n > std::numeric_limits<uint32_t>::max())
+            throw std::invalid_argument{"too many arg lists"};
+
+        auto spec = *this;
+        if(!spec.frozen)
+            spec.freeze();
+        spec.rebase(&prototype, sizeof(Options), &prototype);
+
+        std::vector<expected<std::vector<std::string_view>>> results(n);
+        threads = static_cast<unsigned>(
+            std::clamp<size_t>(threads, 1, std::max<size_t>(n, 1)));
+
+        // Each worker owns the arg lists [begin, end) packed into one word,
+        // it takes them from the front and thieves take halves from the back.
+        struct alignas(64) worker_t
+        {
+            std::atomic<uint64_t> range;
+        };
+        auto pack = [](uint64_t begin, uint64_t end) {
+            return end << 32 | begin;
+        };
+        std::vector<worker_t> workers(threads);
+        for(size_t i = 0; i < threads; i++)
+            workers[i].range = pack(n * i / threads, n * (i + 1) / threads);
+
+        auto take = [&](size_t self) -> size_t {
+            auto& own = workers[self].range;
+            auto range = own.load();
+            while(uint32_t(range) < range >> 32)
+                if(own.compare_exchange_weak(range, range + 1))
+                    return uint32_t(range);
+
+            for(size_t i = 1; i < threads; i++)
+            {
+                auto& victim = workers[(self + i) % threads].range;
+                range = victim.load();
+                while(true)
+                {
+                    uint64_t begin = uint32_t(range), end = range >> 32;
+                    if(begin >= end)
+                        break;
+                    auto mid = begin + (end - begin) / 2;
+                    if(victim.compare_exchange_weak(range, pack(begin, mid)))
+                    {
+                        own.store(pack(mid + 1, end));
+                        return mid;
+                    }
+                }
+            }
+            return n;
+        };
+
+        auto work = [&](size_t self) {
+            auto parser = spec;
+            parse_context_t context;
+            const void* base = &prototype;
+            for(auto i = take(self); i < n; i = take(self))
+            {
+                parser.rebase(base, sizeof(Options), &outputs[i]);
+                base = &outputs[i];
+                outputs[i] = prototype;
+
+                auto& args = std::ranges::begin(arg_lists)[i];
+                auto result = parser.parse(std::span{args}, context);
+                if(result)
+                    results[i].value().assign(result->begin(), result->end());
+                else
+                    results[i] = std::unexpected{std::move(result.error())};
+            }
+        };
+
+        {
+            std::vector<std::jthread> pool;
+            pool.reserve(threads - 1);
+            for(size_t i = 1; i < threads; i++)
+                pool.emplace_back(work, i);
+            work(0);
+        }
+        return results;
+    }
+
+    template <std::convertible_to<std::string_view> String>
+    std::vector<std::string> parser_t::complete(std::span<String> args)
+    {
+        using detail::token_kind_t;
+
+        if(!frozen)
+            freeze();
+
+        std::vector<std::string> ret;
+        std::string_view word = args.empty() ? ""sv : args.back();
+        auto previous = args.first(args.size() - !args.empty());
+
+        auto complete_values = [&](const parse_arg_t& parse_arg,
+                                   std::string_view prefix,
+                                   std::string_view value) {
+            for(auto choice : parse_arg.choices())
+                if(choice.starts_with(value))
+                    ret.push_back(std::format("{}{}", prefix, choice));
+        };
+
+        if(std::ranges::find(previous, "--"sv, [](std::string_view x) {
+               return x;
+           }) != previous.end())
+            return ret;
+
+        if(!word.starts_with('-'))
+        {
+            // The word is a value if it follows a flag missing one
+            auto [tokens, kinds] = detail::semantic_tokenize(previous);
+            if(kinds.empty() || kinds.back() != token_kind_t::flag)
+                return ret;
+
+            auto found = find_flag(tokens.back());
+            if(!found || *found == detail::flag_index_t::npos)
+                return ret;
 
-                auto token = *tb;
-                auto it =
-                    std::find_if(flag_info.begin(), flag_info.end(),
-                                 [token](auto& x) { return x.name == token; });
-                if(it == flag_info.end())
-                {
-                    if(err_unknown)
-                    {
-                        auto dashes = token.size() > 1 ? "--"sv : "-"sv;
-                        return std::unexpected{
-                            std::format("unknown flag {}{}", dashes, token)};
-                    }
+            auto& parse_arg = flag_info[*found].parse_arg;
+            if(parse_arg.kind() != parse_arg_t::boolean)
+                complete_values(parse_arg, "", word);
+            return ret;
+        }
 
-                    remaining.push_back(token);
-                }
-                else
-                {
-                    parse_arg = &it->parse_arg;
-                }
+        auto equal_pos = word.find('=');
+        if(equal_pos != word.npos)
+        {
+            auto [tokens, kinds] = detail::semantic_tokenize(
+                std::span<std::string_view>{&word, 1});
+            if(tokens.size() < 2)
+                return ret;
 
-                tb++;
-                break;
-            }
+            // the flag is the token right before the value
+            auto found = find_flag(tokens[tokens.size() - 2]);
+            if(found && *found != detail::flag_index_t::npos)
+                complete_values(flag_info[*found].parse_arg,
+                                word.substr(0, equal_pos + 1),
+                                word.substr(equal_pos + 1));
+            return ret;
+        }
+
+        if(word.starts_with("--"))
+        {
+            for(auto i : index.find(word.substr(2)).candidates)
+                if(flag_info[i].name.size() > 1)
+                    ret.push_back(std::format("--{}", flag_info[i].name));
+        }
+        else if(word.size() <= 2)
+        {
+            // a lone dash completes to every flag
+            for(auto i : index.find(word.substr(1)).candidates)
+            {
+                auto name = flag_info[i].name;
+                if(word.size() == 2 && name.size() > 1)
+                    continue;
+                auto dashes = name.size() > 1 ? "--"sv : "-"sv;
+                ret.push_back(std::format("{}{}", dashes, name));
             }
         }
+        return ret;
+    }
 
-        if(parse_arg)
+    inline expected<void> parser_t::validate_all()
+    {
+        for(auto& [name, help, parse_arg] : flag_info)
         {
-            auto result = end_of_flag(parse_arg, tb);
+            auto result = parse_arg.validate();
             if(!result)
-                return std::unexpected{result.error()};
+                return result;
         }
-
-        return remaining;
+        for(auto& x : positionals)
+        {
+            auto result = x.parse_arg.validate();
+            if(!result)
+                return result;
+        }
+        return {};
     }
 
     inline void parser_t::flag(flag_name_t name, help_str_t help,
@@ -483,6 +3788,12 @@ namespace cozy
         unguarded_vflag(name.str, help.str, make_parse_arg(target));
     }
 
+    inline void parser_t::flag(flag_name_t name, help_str_t help,
+                               parse_arg_t parse_arg)
+    {
+        unguarded_vflag(name.str, help.str, parse_arg);
+    }
+
     inline void parser_t::vflag(std::string_view name, std::string_view help,
                                 parse_arg_t parse_arg)
     {
@@ -491,20 +3802,101 @@ namespace cozy
         unguarded_vflag(name, help, parse_arg);
     }
 
+    inline void parser_t::owned_flag(std::string_view name,
+                                     std::string_view help,
+                                     parse_arg_t parse_arg, bool share_help)
+    {
+        if(detail::invalid_name(name))
+            throw std::runtime_error{std::format("invalid flag name {}", name)};
+        name = strings.copy(name);
+        help = share_help ? shared_help.intern(help, strings)
+                          : strings.copy(help);
+        unguarded_vflag(name, help, parse_arg);
+    }
+
+    inline void parser_t::positional(std::string_view name,
+                                     std::string_view help,
+                                     builtin_parseable auto& target)
+    {
+        positional(name, help, make_parse_arg(target));
+    }
+
+    inline void parser_t::positional(std::string_view name,
+                                     std::string_view help,
+                                     parse_arg_t parse_arg)
+    {
+        auto n = parse_arg.kind() == parse_arg_t::variable ? variadic : 1;
+        positional(name, help, parse_arg, n);
+    }
+
+    inline void parser_t::positional(std::string_view name,
+                                     std::string_view help,
+                                     parse_arg_t parse_arg, size_t n)
+    {
+        if(n == 0 || (n > 1 && parse_arg.kind() != parse_arg_t::variable))
+            throw std::invalid_argument{
+                std::format("positional {} cannot take {} values", name, n)};
+        if(!positionals.empty() && positionals.back().arity == variadic)
+            throw std::invalid_argument{
+                std::format("positional {} follows variadic {}", name,
+                            positionals.back().name)};
+        positionals.push_back(
+            {.name = name, .help = help, .parse_arg = parse_arg, .arity = n});
+        frozen = false;
+    }
+
+    inline void parser_t::reserve_owned(size_t n, size_t chars)
+    {
+        flag_info.reserve(flag_info.size() + n);
+        strings.reserve(chars);
+        shared_help.reserve(n);
+    }
+
+    inline flag_scope_t parser_t::scope(std::string_view name)
+    {
+        flag_scope_t::check_segment(name);
+        return {*this, strings.copy({"--"sv, name, "."sv})};
+    }
+
+    inline flag_scope_t flag_scope_t::scope(std::string_view name) const
+    {
+        check_segment(name);
+        return {*parser, parser->strings.copy({dotted, name, "."sv})};
+    }
+
+    inline void flag_scope_t::flag(std::string_view name,
+                                   std::string_view help,
+                                   builtin_parseable auto& target) const
+    {
+        flag(name, help, make_parse_arg(target));
+    }
+
+    inline void flag_scope_t::flag(std::string_view name,
+                                   std::string_view help,
+                                   parse_arg_t parse_arg) const
+    {
+        check_segment(name);
+        auto& strings = parser->strings;
+        parser->unguarded_vflag(strings.copy({dotted, name}),
+                                parser->shared_help.intern(help, strings),
+                                parse_arg);
+    }
+
+    inline void flag_scope_t::check_segment(std::string_view name)
+    {
+        if(name.empty() || name.starts_with('-') || name.starts_with('.') ||
+           name.ends_with('.') || name.find_first_of("= \t\n") != name.npos)
+            throw std::runtime_error{
+                std::format("invalid flag name segment {}", name)};
+    }
+
     template <std::output_iterator<char> It>
     auto parser_t::options_to(It it) const -> It
     {
-        using namespace std::ranges;
-
-        size_t longest = max(flag_info | views::transform(flag_len));
+        size_t longest = longest_name();
         std::string indent(longest + 6, ' ');
 
-        for(auto& [name, help, _] : flag_info)
-        {
-            auto dashes = name.size() > 1 ? "--"sv : "-"sv;
-            it = std::format_to(it, "{:>{}}{}{}  ", ' ',
-                                longest - dashed_len(name) + 4, dashes, name);
-
+        auto put_help = [&](std::string_view help) {
             for(auto c : help)
             {
                 *it++ = c;
@@ -512,6 +3904,20 @@ namespace cozy
                     it = std::copy(indent.begin(), indent.end(), it);
             }
             *it++ = '\n';
+        };
+
+        for(auto& [name, help, _] : flag_info)
+        {
+            auto dashes = name.size() > 1 ? "--"sv : "-"sv;
+            it = std::format_to(it, "{:>{}}{}{}  ", ' ',
+                                longest - dashed_len(name) + 4, dashes, name);
+            put_help(help);
+        }
+        for(auto& x : positionals)
+        {
+            it = std::format_to(it, "{:>{}}{}  ", ' ',
+                                longest - x.name.size() + 4, x.name);
+            put_help(x.help);
         }
         return it;
     }
@@ -528,33 +3934,451 @@ namespace cozy
     inline size_t parser_t::options_len(int help_newlines) const
     {
         using namespace std::ranges;
-        size_t longest = max(flag_info | views::transform(flag_len));
+        size_t longest = longest_name();
 
         // approximate due to newline in help requiring indentation
-        auto approx_help_lens =
-            flag_info | views::transform([](auto& x) { return x.help.size(); });
-        size_t approx_sum = std::accumulate(approx_help_lens.begin(),
-                                            approx_help_lens.end(), 0);
+        auto help_len = [](auto& x) { return x.help.size(); };
+        auto approx_help_lens = flag_info | views::transform(help_len);
+        auto positional_help_lens = positionals | views::transform(help_len);
+        size_t approx_sum =
+            std::accumulate(approx_help_lens.begin(), approx_help_lens.end(),
+                            size_t(0)) +
+            std::accumulate(positional_help_lens.begin(),
+                            positional_help_lens.end(), size_t(0));
 
-        // Padding is longest + 6, each entry in flag_info also requires an
-        // extra newline.
+        // Padding is longest + 6, each entry in flag_info and positionals
+        // also requires an extra newline.
         // Keep in sync with options_to format.
-        return approx_sum + (longest + 6) * (flag_info.size() + help_newlines) +
-               flag_info.size();
+        auto entries = flag_info.size() + positionals.size();
+        return approx_sum + (longest + 6) * (entries + help_newlines) + entries;
+    }
+
+    template <std::output_iterator<char> It>
+    auto parser_t::dump_to(It it, bool json) const -> It
+    {
+        if constexpr(std::is_same_v<It, char*>)
+        {
+            detail::dump_writer_t out{.data = it, .json = json};
+            dump_with(out);
+            return it + out.size;
+        }
+        else
+        {
+            auto buf = dump(json);
+            return std::copy(buf.begin(), buf.end(), it);
+        }
+    }
+
+    inline std::string parser_t::dump(bool json) const
+    {
+        std::string buf(dump_len(json), '\0');
+        dump_to(buf.data(), json);
+        return buf;
+    }
+
+#if __has_include(<unistd.h>)
+    inline expected<void> parser_t::dump(int fd, bool json) const
+    {
+        auto buf = dump(json);
+        std::string_view rest = buf;
+        while(!rest.empty())
+        {
+            auto n = ::write(fd, rest.data(), rest.size());
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0)
+                return std::unexpected{
+                    std::format("cannot write dump: {}", std::strerror(errno))};
+            rest.remove_prefix(n);
+        }
+        return {};
+    }
+#endif
+
+    inline size_t parser_t::dump_len(bool json) const
+    {
+        detail::dump_writer_t out{.json = json};
+        dump_with(out);
+        return out.size;
+    }
+
+    inline void parser_t::dump_with(detail::dump_writer_t& out) const
+    {
+        if(out.json)
+            out.put('{');
+        for(size_t i = 0; i < flag_info.size(); i++)
+        {
+            auto& [name, help, parse_arg] = flag_info[i];
+            if(out.json)
+            {
+                if(i > 0)
+                    out.put(',');
+                out.string(name);
+                out.put(':');
+                parse_arg.dump(out);
+            }
+            else
+            {
+                out.put(name);
+                out.put('=');
+                parse_arg.dump(out);
+                out.put('\n');
+            }
+        }
+        for(size_t i = 0; i < positionals.size(); i++)
+        {
+            auto& x = positionals[i];
+            if(out.json)
+            {
+                if(i + flag_info.size() > 0)
+                    out.put(',');
+                out.string(x.name);
+                out.put(':');
+                x.parse_arg.dump(out);
+            }
+            else
+            {
+                out.put(x.name);
+                out.put('=');
+                x.parse_arg.dump(out);
+                out.put('\n');
+            }
+        }
+        if(out.json)
+            out.put("}\n"sv);
     }
 
     inline void parser_t::unguarded_vflag(std::string_view name,
                                           std::string_view help,
                                           parse_arg_t parse_arg)
+    {
+        flag_info.push_back(
+            {.name = undashed(name), .help = help, .parse_arg = parse_arg});
+        frozen = false;
+    }
+
+    inline void parser_t::require(std::string_view name)
+    {
+        check_rule_names({name});
+        rules.push_back({.kind = rule_t::required, .names = {name}});
+        frozen = false;
+    }
+
+    inline void
+    parser_t::exclusive(std::initializer_list<std::string_view> names)
+    {
+        check_rule_names(names);
+        rules.push_back({.kind = rule_t::exclusive, .names = names});
+        frozen = false;
+    }
+
+    inline void
+    parser_t::depends(std::string_view name,
+                      std::initializer_list<std::string_view> requisites)
+    {
+        check_rule_names({name});
+        check_rule_names(requisites);
+        rules.push_back({.kind = rule_t::depends, .names = {name}});
+        rules.back().names.insert(rules.back().names.end(), requisites);
+        frozen = false;
+    }
+
+    inline void parser_t::freeze()
+    {
+        index.build(flag_info.size(),
+                    [this](uint32_t i) { return flag_info[i].name; });
+        seen.assign((flag_info.size() + 63) / 64, 0);
+        unhashed.resize(seen.size());
+
+        for(; compiled_rules < rules.size(); compiled_rules++)
+        {
+            auto& rule = rules[compiled_rules];
+            for(size_t i = 0; i < rule.names.size(); i++)
+            {
+                auto exact = index.find(undashed(rule.names[i])).exact;
+                if(exact == detail::flag_index_t::npos)
+                    throw std::runtime_error{
+                        std::format("unknown flag {} in rule", rule.names[i])};
+
+                if(rule.kind == rule_t::required)
+                    required_flags.insert(exact);
+                else if(rule.kind == rule_t::depends && i > 0)
+                    rule.requisites.insert(exact);
+                else
+                    rule.flags.insert(exact);
+            }
+            rule.names = {};
+        }
+        snapshot_defaults();
+        frozen = true;
+    }
+
+    inline void parser_t::snapshot_defaults()
+    {
+        struct piece_t
+        {
+            std::byte* target;
+            size_t size;
+            const std::byte* value;
+        };
+        std::vector<piece_t> pieces;
+        for(auto& block : default_blocks)
+            pieces.push_back({block.target, block.size,
+                              default_bytes.data() + block.offset});
+
+        auto snapshot = [&](const parse_arg_t& parse_arg, size_t i,
+                            bool positional) {
+            auto bytes = parse_arg.trivial_bytes();
+            if(!bytes.empty())
+                pieces.push_back({bytes.data(), bytes.size(), bytes.data()});
+            else if(auto value = parse_arg.snapshot())
+                default_values.push_back({static_cast<uint32_t>(i),
+                                          positional, std::move(value)});
+        };
+        for(; snapshotted < flag_info.size(); snapshotted++)
+        {
+            auto hash = flag_hash(snapshotted);
+            flag_hashes.push_back({0, hash, hash});
+            snapshot(flag_info[snapshotted].parse_arg, snapshotted, false);
+        }
+        for(auto& i = snapshotted_positionals; i < positionals.size(); i++)
+        {
+            auto hash = positional_hash(i);
+            positional_hashes.push_back(
+                {static_cast<uint32_t>(i), hash, hash});
+            snapshot(positionals[i].parse_arg, i, true);
+        }
+
+        // Pieces overlap if several flags share a target.
+        std::ranges::sort(pieces, std::less{}, &piece_t::target);
+        std::vector<default_block_t> blocks;
+        std::vector<std::byte> bytes;
+        for(auto& piece : pieces)
+        {
+            auto end = blocks.empty()
+                           ? nullptr
+                           : blocks.back().target + blocks.back().size;
+            if(end && piece.target <= end)
+            {
+                if(piece.target + piece.size <= end)
+                    continue;
+                auto skipped = static_cast<size_t>(end - piece.target);
+                blocks.back().size += piece.size - skipped;
+                bytes.insert(bytes.end(), piece.value + skipped,
+                             piece.value + piece.size);
+            }
+            else
+            {
+                blocks.push_back({piece.target, bytes.size(), piece.size});
+                bytes.insert(bytes.end(), piece.value,
+                             piece.value + piece.size);
+            }
+        }
+        default_blocks = std::move(blocks);
+        default_bytes = std::move(bytes);
+
+        std::vector<std::pair<const void*, uint32_t>> targets;
+        for(uint32_t i = 0; i < flag_info.size(); i++)
+            targets.push_back({flag_info[i].parse_arg.address(), i});
+        std::ranges::sort(targets, std::less{});
+        // The first flag of a target is the one added first, so flags added
+        // since the last freeze don't change the first flags of old targets.
+        default_fingerprint = last_fingerprint = 0;
+        for(size_t i = 0; i < targets.size(); i++)
+        {
+            auto [target, flag] = targets[i];
+            if(i > 0 && target && target == targets[i - 1].first)
+                flag_hashes[flag].first = flag_hashes[targets[i - 1].second].first;
+            else
+            {
+                flag_hashes[flag].first = flag;
+                default_fingerprint += flag_hashes[flag].default_hash;
+                last_fingerprint += flag_hashes[flag].hash;
+            }
+        }
+        for(auto& x : positional_hashes)
+        {
+            default_fingerprint += x.default_hash;
+            last_fingerprint += x.hash;
+        }
+        rehashed.assign(seen.size(), 0);
+    }
+
+    inline uint64_t parser_t::flag_hash(uint32_t i) const
+    {
+        auto name = flag_info[i].name;
+        return detail::mix64(detail::hash_bytes(name.data(), name.size()) +
+                             flag_info[i].parse_arg.hash());
+    }
+
+    inline uint64_t parser_t::positional_hash(uint32_t i) const
+    {
+        auto name = positionals[i].name;
+        return detail::mix64(detail::hash_bytes(name.data(), name.size()) +
+                             positionals[i].parse_arg.hash());
+    }
+
+    inline uint64_t parser_t::fingerprint()
+    {
+        if(!frozen)
+            freeze();
+
+        // A flag stays unhashed if hashing its target throws.
+        std::ranges::fill(rehashed, 0);
+        for(size_t w = 0; w < unhashed.size(); w++)
+        {
+            while(auto bits = unhashed[w])
+            {
+                auto first = flag_hashes[w * 64 + std::countr_zero(bits)].first;
+                auto& word = rehashed[first / 64];
+                auto bit = uint64_t(1) << (first % 64);
+                if(!(word & bit))
+                {
+                    auto hash = flag_hash(first);
+                    last_fingerprint += hash - flag_hashes[first].hash;
+                    flag_hashes[first].hash = hash;
+                    word |= bit;
+                }
+                unhashed[w] = bits & (bits - 1);
+            }
+        }
+
+        if(positionals_unhashed)
+        {
+            for(uint32_t i = 0; i < positionals.size(); i++)
+            {
+                auto hash = positional_hash(i);
+                last_fingerprint += hash - positional_hashes[i].hash;
+                positional_hashes[i].hash = hash;
+            }
+            positionals_unhashed = false;
+        }
+        return last_fingerprint;
+    }
+
+    inline void parser_t::rebase(const void* from, size_t size,
+                                 const void* to)
+    {
+        auto first = reinterpret_cast<uintptr_t>(from);
+        auto offset = static_cast<ptrdiff_t>(reinterpret_cast<uintptr_t>(to) -
+                                             first);
+        for(auto& x : flag_info)
+            if(!x.parse_arg.rebase(first, size, offset))
+                throw std::invalid_argument{std::format(
+                    "target of {} is outside of the options", dashed(x.name))};
+        for(auto& x : positionals)
+            if(!x.parse_arg.rebase(first, size, offset))
+                throw std::invalid_argument{std::format(
+                    "target of {} is outside of the options", x.name)};
+        for(auto& block : default_blocks)
+            block.target += offset;
+    }
+
+    inline void parser_t::reset_to_defaults()
+    {
+        if(!frozen)
+            freeze();
+        for(auto& block : default_blocks)
+            std::memcpy(block.target, default_bytes.data() + block.offset,
+                        block.size);
+        for(auto& [i, positional, value] : default_values)
+        {
+            auto& parse_arg = positional ? positionals[i].parse_arg
+                                         : flag_info[i].parse_arg;
+            parse_arg.restore(value.get());
+        }
+        std::ranges::fill(seen, 0);
+        std::ranges::fill(unhashed, 0);
+        positionals_unhashed = false;
+        for(auto& x : flag_hashes)
+            x.hash = x.default_hash;
+        for(auto& x : positional_hashes)
+            x.hash = x.default_hash;
+        last_fingerprint = default_fingerprint;
+    }
+
+    inline bool parser_t::was_set(std::string_view name) const
+    {
+        // precondition: frozen
+        if(detail::invalid_name(name))
+            return false;
+        auto exact = index.find(undashed(name)).exact;
+        return exact != detail::flag_index_t::npos &&
+               (seen[exact / 64] >> (exact % 64) & 1);
+    }
+
+    inline expected<void> parser_t::check_rules() const
+    {
+        auto names_of = [this](const detail::flag_set_t& flags, auto in) {
+            std::string names;
+            flags.for_each<decltype(in)::value>(seen, [&](uint32_t i) {
+                names += std::format(" {}", dashed(flag_info[i].name));
+            });
+            return names;
+        };
+
+        if(!required_flags.all_in(seen))
+            return std::unexpected{
+                std::format("missing required flags{}",
+                            names_of(required_flags, std::false_type{}))};
+
+        for(auto& rule : rules)
+        {
+            if(rule.kind == rule_t::exclusive && rule.flags.count_in(seen) > 1)
+                return std::unexpected{
+                    std::format("flags{} are mutually exclusive",
+                                names_of(rule.flags, std::true_type{}))};
+
+            if(rule.kind == rule_t::depends && rule.flags.count_in(seen) &&
+               !rule.requisites.all_in(seen))
+                return std::unexpected{std::format(
+                    "flag{} requires{}", names_of(rule.flags, std::true_type{}),
+                    names_of(rule.requisites, std::false_type{}))};
+        }
+        return {};
+    }
+
+    inline expected<uint32_t> parser_t::find_flag(std::string_view token) const
+    {
+        auto [exact, candidates] = index.find(token);
+        if(exact != detail::flag_index_t::npos)
+            return exact;
+
+        // Single characters are short flags, they are never abbreviations.
+        if(token.size() < 2 || candidates.empty())
+            return detail::flag_index_t::npos;
+
+        // Equal names can only be duplicate registrations, the first wins.
+        if(flag_info[candidates.front()].name ==
+           flag_info[candidates.back()].name)
+            return candidates.front();
+
+        std::string names;
+        for(auto i : candidates)
+            names += std::format(" --{}", flag_info[i].name);
+        return std::unexpected{
+            std::format("ambiguous flag --{} could be{}", token, names)};
+    }
+
+    inline void
+    parser_t::check_rule_names(std::initializer_list<std::string_view> names)
+    {
+        for(auto name : names)
+            if(detail::invalid_name(name))
+                throw std::runtime_error{
+                    std::format("invalid flag name {} in rule", name)};
+    }
+
+    inline std::string_view parser_t::undashed(std::string_view name)
     {
         // precondition: name.size() > 1
-        if(name[1] == '-')
-            name = name.substr(2);
-        else
-            name = name.substr(1);
+        return name.substr(name[1] == '-' ? 2 : 1);
+    }
 
-        flag_info.push_back(
-            {.name = name, .help = help, .parse_arg = parse_arg});
+    inline std::string parser_t::dashed(std::string_view name)
+    {
+        auto dashes = name.size() > 1 ? "--"sv : "-"sv;
+        return std::format("{}{}", dashes, name);
     }
 
     inline size_t parser_t::dashed_len(std::string_view name)
@@ -567,4 +4391,14 @@ namespace cozy
         return dashed_len(x.name);
     };
 
+    inline size_t parser_t::longest_name() const
+    {
+        size_t longest = 0;
+        for(auto& x : flag_info)
+            longest = std::max(longest, flag_len(x));
+        for(auto& x : positionals)
+            longest = std::max(longest, x.name.size());
+        return longest;
+    }
+
 } // namespace cozy
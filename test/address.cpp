@@ -0,0 +1,123 @@
+// Addresses against inet_pton, on fixed cases and random strings.
+// g++ -std=c++23 -I. test/address.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <arpa/inet.h>
+
+#include <cassert>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+
+bool same_as_inet_pton(const std::string& s)
+{
+    cozy::ipv4_address v4;
+    cozy::ipv6_address v6;
+    unsigned char b4[4], b6[16];
+    bool x4 = bool(cozy::parser_traits<cozy::ipv4_address>::parse(s, &v4));
+    bool y4 = inet_pton(AF_INET, s.c_str(), b4) == 1;
+    bool x6 = bool(cozy::parser_traits<cozy::ipv6_address>::parse(s, &v6));
+    bool y6 = inet_pton(AF_INET6, s.c_str(), b6) == 1;
+    return x4 == y4 && (!x4 || std::memcmp(v4.bytes.data(), b4, 4) == 0) &&
+           x6 == y6 && (!x6 || std::memcmp(v6.bytes.data(), b6, 16) == 0);
+}
+
+std::string random_ipv4(std::mt19937& rng)
+{
+    std::string s;
+    for(int i = 0; i < 4; i++)
+    {
+        if(i > 0)
+            s += '.';
+        s += std::to_string(rng() % 300);
+    }
+    if(rng() % 4 == 0)
+        s.insert(rng() % s.size(), "0");
+    return s;
+}
+
+std::string random_ipv6(std::mt19937& rng)
+{
+    static constexpr std::string_view hex = "0123456789abcdefABCDEF";
+    std::string s;
+    int groups = 1 + rng() % 8;
+    int gap = rng() % 3 == 0 ? -1 : int(rng() % (groups + 1));
+    bool v4 = rng() % 4 == 0;
+    for(int i = 0; i < groups; i++)
+    {
+        if(i == gap)
+            s += "::";
+        else if(i > 0)
+            s += ':';
+        if(v4 && i == groups - 1)
+            s += random_ipv4(rng);
+        else
+            for(int n = 1 + rng() % (rng() % 8 == 0 ? 5 : 4); n > 0; n--)
+                s += hex[rng() % hex.size()];
+    }
+    if(gap == groups)
+        s += "::";
+    return s;
+}
+
+bool endpoint_is(std::string_view s, std::string_view host, uint16_t port)
+{
+    cozy::endpoint e;
+    return cozy::parser_traits<cozy::endpoint>::parse(s, &e) &&
+           e.host == host && e.port == port;
+}
+
+bool endpoint_fails(std::string_view s)
+{
+    cozy::endpoint e;
+    return !cozy::parser_traits<cozy::endpoint>::parse(s, &e);
+}
+
+int main()
+{
+    for(auto s : {"::", "1::", "::1", "1:2:3:4:5:6:7::", "::2:3:4:5:6:7:8",
+                  "1:2:3:4:5:6:7:8", "::ffff:1.2.3.4", "1:2:3:4:5:6:1.2.3.4",
+                  "1.2.3.4", "0.0.0.0", "255.255.255.255", "01.2.3.4",
+                  "1.2.3.04", "1.2.3.00", "256.1.1.1", "1.2.3", "1.2.3.4.",
+                  "1.2.3.4::", "::1.2.3.04", "1:2:3:4:5:6:7:8::", "1::2::3",
+                  ":1::", "1:", "[::1]", "", "12345::", "ABCD::ef01"})
+        assert(same_as_inet_pton(s));
+
+    cozy::ipv6_address v6;
+    assert(cozy::parser_traits<cozy::ipv6_address>::parse("::ffff:1.2.3.4",
+                                                         &v6));
+    assert(v6.bytes[10] == 0xff && v6.bytes[11] == 0xff &&
+           v6.bytes[12] == 1 && v6.bytes[15] == 4);
+
+    assert(endpoint_is("[::1]:80", "::1", 80));
+    assert(endpoint_is("1.2.3.4:0", "1.2.3.4", 0));
+    assert(endpoint_is("example.com:65535", "example.com", 65535));
+    assert(endpoint_fails(":80"));
+    assert(endpoint_fails("[]:80"));
+    assert(endpoint_fails("example.com:"));
+    assert(endpoint_fails("[::1]:"));
+    assert(endpoint_fails("[::1]"));
+    assert(endpoint_fails("1.2.3.4:65536"));
+    assert(endpoint_fails("01.2.3.4:80"));
+
+    std::mt19937 rng(1);
+    static constexpr std::string_view chars = "0123456789abcdefABCDEFg.:::";
+    for(int i = 0; i < 300000; i++)
+    {
+        std::string s;
+        switch(i % 3)
+        {
+        case 0:
+            s = random_ipv4(rng);
+            break;
+        case 1:
+            s = random_ipv6(rng);
+            break;
+        default:
+            for(int n = rng() % 20; n > 0; n--)
+                s += chars[rng() % chars.size()];
+        }
+        assert(same_as_inet_pton(s));
+    }
+}
@@ -0,0 +1,74 @@
+// g++ -std=c++23 -I. test/command_line.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+bool splits_to(std::string_view line,
+               std::initializer_list<std::string_view> args)
+{
+    cozy::command_line cl;
+    auto r = cl.split(line);
+    assert(r);
+    return std::ranges::equal(cl.args(), args);
+}
+
+std::string error_of(std::string_view line)
+{
+    cozy::command_line cl;
+    auto r = cl.split(line);
+    assert(!r);
+    return r.error();
+}
+
+int main()
+{
+    assert(splits_to("", {}));
+    assert(splits_to(" \t\n", {}));
+    assert(splits_to("a  b\tc\nd", {"a", "b", "c", "d"}));
+
+    // line continuations
+    assert(splits_to("ab \\\n cd", {"ab", "cd"}));
+    assert(splits_to("ab\\\n cd", {"ab", "cd"}));
+    assert(splits_to("ab \\\ncd", {"ab", "cd"}));
+    assert(splits_to("a\\\nb", {"ab"}));
+    assert(splits_to("\\\n", {}));
+    assert(splits_to("\\\n\\\n a \\\n\\\n", {"a"}));
+    assert(splits_to("--out \\\n  x.txt \\\n  --verbose",
+                     {"--out", "x.txt", "--verbose"}));
+
+    // empty quotes are empty arguments
+    assert(splits_to("''", {""}));
+    assert(splits_to("\"\"", {""}));
+    assert(splits_to("a '' \"\" b", {"a", "", "", "b"}));
+    assert(splits_to("''\\\n", {""}));
+
+    // mixed quotes
+    assert(splits_to("x\"y z\"w", {"xy zw"}));
+    assert(splits_to("'it''s'", {"its"}));
+    assert(splits_to("'a'\"b\"c", {"abc"}));
+    assert(splits_to("'don'\\''t'", {"don't"}));
+    assert(splits_to("'a \\ \"b\"'", {"a \\ \"b\""}));
+
+    // escapes
+    assert(splits_to("a\\ b\\'c\\\\", {"a b'c\\"}));
+    assert(splits_to("\"a\\\"b\\\\c\\$d\\`e\"", {"a\"b\\c$d`e"}));
+    assert(splits_to("\"a\\nb\"", {"a\\nb"}));
+    assert(splits_to("\"a\\\nb\"", {"ab"}));
+
+    // errors
+    assert(error_of("'abc") == "unterminated ' in command line");
+    assert(error_of("a \"bc") == "unterminated \" in command line");
+    assert(error_of("\"bc\\\"") == "unterminated \" in command line");
+    assert(error_of("abc\\") == "trailing \\ in command line");
+    assert(error_of("\\") == "trailing \\ in command line");
+
+    // reuse replaces the previous arguments
+    cozy::command_line cl;
+    assert(cl.split("x \"y z\" w"));
+    assert(cl.split("short"));
+    assert(cl.args().size() == 1 && cl.args()[0] == "short");
+}
@@ -0,0 +1,67 @@
+// g++ -std=c++23 -I. test/lazy.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <array>
+#include <cassert>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+struct counted
+{
+    static inline int conversions = 0;
+    int value = 0;
+};
+
+template <>
+struct cozy::parser_traits<counted>
+{
+    static constexpr auto kind = cozy::detail::flag_kind_t::single;
+
+    static cozy::expected<void> parse(std::string_view s, counted* target)
+    {
+        counted::conversions++;
+        target->value = std::stoi(std::string{s});
+        return {};
+    }
+};
+
+template <size_t N>
+auto parse(cozy::parser_t& parser, std::array<const char*, N> args)
+{
+    return parser.parse(std::span<const char*>{args});
+}
+
+int main()
+{
+    cozy::lazy<counted> count;
+    cozy::parser_t parser;
+    parser.flag("--count", "count", count);
+
+    // given but unread, so parse doesn't convert it
+    assert(parse(parser, std::array{"--count", "42"}));
+    assert(counted::conversions == 0);
+
+    // the fingerprint converts it once, reading it afterwards doesn't
+    auto fingerprint = parser.fingerprint();
+    assert(counted::conversions == 1);
+    assert(count.get()->value == 42 && counted::conversions == 1);
+    assert(parser.fingerprint() == fingerprint && counted::conversions == 1);
+
+    // a throwing conversion is deferred too, and propagates from fingerprint
+    cozy::lazy<counted> bad;
+    cozy::parser_t throwing;
+    throwing.flag("--bad", "bad", bad);
+    assert(parse(throwing, std::array{"--bad", "x"}));
+    bool threw = false;
+    try
+    {
+        (void)throwing.fingerprint();
+    }
+    catch(const std::invalid_argument&)
+    {
+        threw = true;
+    }
+    assert(threw);
+}
@@ -0,0 +1,55 @@
+// g++ -std=c++23 -I. test/positional.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <array>
+#include <cassert>
+#include <span>
+#include <string>
+#include <vector>
+
+template <size_t N>
+auto parse(cozy::parser_t& parser, std::array<const char*, N> args)
+{
+    return parser.parse(std::span<const char*>{args});
+}
+
+int main()
+{
+    int n = 0;
+    std::string out = "a.out";
+    std::vector<int> nums;
+    cozy::parser_t parser;
+    parser.flag("-n", "n", n);
+    parser.positional("out", "output file", out);
+    parser.positional("nums", "numbers", nums);
+    parser.freeze();
+    auto defaults = parser.fingerprint();
+
+    assert(parse(parser, std::array{"x", "1", "2", "3", "4"}));
+    assert(out == "x" && nums.size() == 4);
+    auto first = parser.fingerprint();
+    assert(first != defaults);
+    assert(parser.dump() == "n=0\nout=x\nnums=1,2,3,4\n");
+
+    parser.reset_to_defaults();
+    assert(out == "a.out" && nums.empty());
+    assert(parser.fingerprint() == defaults);
+
+    assert(parse(parser, std::array{"x", "1", "2", "3", "5"}));
+    assert(nums == (std::vector<int>{1, 2, 3, 5}));
+    assert(parser.fingerprint() != first);
+
+    parser.reset_to_defaults();
+    assert(parse(parser, std::array{"x", "1", "2", "3", "4"}));
+    assert(parser.fingerprint() == first);
+
+    // strings that would split an element or a line are quoted
+    std::string name;
+    std::vector<std::string> words;
+    cozy::parser_t quoting;
+    quoting.flag("--name", "name", name);
+    quoting.positional("words", "words", words);
+    quoting.freeze();
+    assert(parse(quoting, std::array{"--name", "a b", "x,y", "k=v", "z"}));
+    assert(quoting.dump() == "name=\"a b\"\nwords=\"x,y\",\"k=v\",z\n");
+}
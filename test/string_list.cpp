@@ -0,0 +1,39 @@
+// g++ -std=c++23 -I. test/string_list.cpp && ./a.out
+#include "cozy.hpp"
+
+#include <array>
+#include <cassert>
+#include <span>
+#include <string_view>
+
+template <size_t N>
+auto parse(cozy::parser_t& parser, std::array<const char*, N> args)
+{
+    return parser.parse(std::span<const char*>{args});
+}
+
+int main()
+{
+    cozy::string_list files;
+    cozy::parser_t parser;
+    parser.flag("--files", "files",
+                cozy::make_parse_arg<[](std::string_view s) {
+                    return s.ends_with(".txt");
+                }>(files));
+
+    assert(parse(parser, std::array{"--files", "a.txt", "b.txt"}));
+    assert(files.size() == 2 && files[0] == "a.txt" && files[1] == "b.txt");
+
+    files.clear();
+    auto result = parse(parser, std::array{"--files", "a.txt", "b.png"});
+    assert(!result && result.error().find("position 1") != std::string::npos);
+
+    files.clear();
+    cozy::parser_t split;
+    split.flag("--files", "files",
+               cozy::make_parse_arg<[](std::string_view s) {
+                   return !s.empty();
+               }>(files, ','));
+    assert(parse(split, std::array{"--files=x,y,z"}) && files.size() == 3);
+    assert(!parse(split, std::array{"--files=x,,z"}));
+}